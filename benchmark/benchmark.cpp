@@ -0,0 +1,747 @@
+// Headless benchmark for the spatial queries. Generates seeded scenes, times
+// building and querying every index and prints one row per measurement as
+// CSV or JSON. Run with --help for the options.
+
+#define SDL_MAIN_HANDLED
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "broadphase.h"
+#include "brute_force.h"
+#include "bvh.h"
+#include "bvh4.h"
+#include "compressed_bvh.h"
+#include "dynamic_bvh.h"
+#include "thread_pool.h"
+#include "uniform_grid.h"
+
+using namespace glm;
+using namespace std;
+
+namespace
+{
+	using clock_type = chrono::steady_clock;
+
+	struct settings
+	{
+		vector<size_t> sizes			= { 1000, 10000, 100000, 1000000 };
+		vector<string> distributions	= { "uniform", "clustered", "powerlaw" };
+		size_t queries					= 1000;
+		size_t repeats					= 5;
+		uint32_t seed					= 42;
+		unsigned threads				= 0;
+		bool json						= false;
+		bool validate					= false;
+		size_t brute_force_limit		= 1000000;	// Largest scene for brute force point and range queries
+		size_t brute_force_pairs_limit	= 20000;	// Largest scene for brute force pairs
+	};
+
+	struct scene
+	{
+		vector<object_2d> objects;
+		vec2 size;
+		float mean_radius = 0.0f;
+	};
+
+	/// One measurement, times are in microseconds
+	struct row
+	{
+		string distribution;
+		size_t objects;
+		string index;
+		string operation;
+		size_t samples;
+		double min;
+		double median;
+		double p99;
+		bool counts_nodes;		// Whether the index counted nodes_visited, printed empty or null if not
+		double nodes_visited;
+		size_t bytes;
+		double results;
+	};
+
+	/// An index as seen by the benchmark, operations it doesn't support are left empty
+	struct index_runner
+	{
+		string name;
+		function<void()> build;
+		function<size_t()> bytes;
+		function<void(vec2, vector<object_2d*>&)> point;
+		function<void(const vec2*, size_t, vector<object_2d*>*)> point_packet;
+		function<void(const aabb&, vector<object_2d*>&)> range;
+		function<size_t(vec2)> point_nodes;
+		function<size_t(const aabb&)> range_nodes;
+		function<void(vector<object_pair>&)> pairs;
+	};
+
+	vector<string> split(const string& list)
+	{
+		vector<string> items;
+		size_t from = 0;
+		while (from <= list.size())
+		{
+			auto to = list.find(',', from);
+			if (to == string::npos)
+				to = list.size();
+			if (to > from)
+				items.push_back(list.substr(from, to - from));
+			from = to + 1;
+		}
+		return items;
+	}
+
+	void print_usage()
+	{
+		fprintf(stderr,
+			"usage: benchmark [options]\n"
+			"  --sizes 1000,10000,...           object counts (default 1000,10000,100000,1000000)\n"
+			"  --distributions uniform,...      uniform, clustered and/or powerlaw (default all)\n"
+			"  --queries N                      point and range queries per scene (default 1000)\n"
+			"  --repeats N                      builds, pair searches and moves per scene (default 5)\n"
+			"  --seed N                         seed for the scenes and queries (default 42)\n"
+			"  --threads N                      threads for building and pairs, 0 for all (default 0)\n"
+			"  --format csv|json                output format (default csv)\n"
+			"  --validate                       check every index against brute force\n"
+			"  --brute-force-limit N            largest scene for brute force queries (default 1000000)\n"
+			"  --brute-force-pairs-limit N      largest scene for brute force pairs (default 20000)\n");
+	}
+
+	bool parse(int argc, char** argv, settings& s)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const string arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (arg == "--validate")
+				s.validate = true;
+			else if (arg == "--sizes" && has_value)
+			{
+				s.sizes.clear();
+				for (const auto& item : split(argv[++i]))
+					s.sizes.push_back(size_t(strtoull(item.c_str(), nullptr, 10)));
+			}
+			else if (arg == "--distributions" && has_value)
+				s.distributions = split(argv[++i]);
+			else if (arg == "--queries" && has_value)
+				s.queries = size_t(strtoull(argv[++i], nullptr, 10));
+			else if (arg == "--repeats" && has_value)
+				s.repeats = std::max(size_t(strtoull(argv[++i], nullptr, 10)), size_t(1));
+			else if (arg == "--seed" && has_value)
+				s.seed = uint32_t(strtoul(argv[++i], nullptr, 10));
+			else if (arg == "--threads" && has_value)
+				s.threads = unsigned(strtoul(argv[++i], nullptr, 10));
+			else if (arg == "--format" && has_value)
+				s.json = string(argv[++i]) == "json";
+			else if (arg == "--brute-force-limit" && has_value)
+				s.brute_force_limit = size_t(strtoull(argv[++i], nullptr, 10));
+			else if (arg == "--brute-force-pairs-limit" && has_value)
+				s.brute_force_pairs_limit = size_t(strtoull(argv[++i], nullptr, 10));
+			else
+				return false;
+		}
+
+		for (const auto& d : s.distributions)
+		{
+			if (d != "uniform" && d != "clustered" && d != "powerlaw")
+				return false;
+		}
+		return true;
+	}
+
+	/// Scenes keep about one object per 100 square units, whatever their size
+	scene generate(const string& distribution, size_t count, uint32_t seed)
+	{
+		scene sc;
+		mt19937 random(seed);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		const float side = sqrt(float(count) * 100.0f);
+		sc.size = vec2(side, side);
+		sc.objects.resize(count);
+
+		if (distribution == "clustered")
+		{
+			const size_t clusters = std::max(count / 1000, size_t(1));
+			const float sigma = side / sqrt(float(clusters)) / 6.0f;
+			vector<vec2> centers(clusters);
+			for (auto& c : centers)
+				c = vec2(unit(random), unit(random)) * side;
+
+			normal_distribution<float> spread(0.0f, sigma);
+			for (auto& o : sc.objects)
+			{
+				const vec2 center = centers[random() % clusters];
+				o.position = clamp(center + vec2(spread(random), spread(random)), vec2(0.0f), sc.size);
+			}
+		}
+		else
+		{
+			for (auto& o : sc.objects)
+				o.position = vec2(unit(random), unit(random)) * side;
+		}
+
+		for (auto& o : sc.objects)
+		{
+			if (distribution == "powerlaw")
+			{
+				// Pareto with shape 1.5 (density falling off as r^-2.5), many small objects and a few large ones
+				const float r = 1.0f / pow(1.0f - unit(random), 1.0f / 1.5f);
+				o.radius = std::min(r, 50.0f);
+			}
+			else
+			{
+				o.radius = 1.0f + 3.0f * unit(random);
+			}
+			o.color = { 255, 255, 255, 255 };
+			sc.mean_radius += o.radius;
+		}
+		if (count)
+			sc.mean_radius /= float(count);
+		return sc;
+	}
+
+	void summarize(vector<double>& samples, row& r)
+	{
+		r.samples = samples.size();
+		if (samples.empty())
+		{
+			r.min = r.median = r.p99 = 0.0;
+			return;
+		}
+		sort(samples.begin(), samples.end());
+		r.min = samples.front();
+		r.median = samples[samples.size() / 2];
+		r.p99 = samples[std::min(samples.size() - 1, size_t(double(samples.size()) * 0.99))];
+	}
+
+	double microseconds(clock_type::time_point from, clock_type::time_point to)
+	{
+		return chrono::duration<double, micro>(to - from).count();
+	}
+
+	bool same(vector<object_2d*> a, vector<object_2d*> b)
+	{
+		sort(a.begin(), a.end());
+		sort(b.begin(), b.end());
+		return a == b;
+	}
+
+	/// Nodes visited as printed, or the given text for indices that don't count them
+	string nodes_visited(const row& r, const char* missing)
+	{
+		if (!r.counts_nodes)
+			return missing;
+		char text[32];
+		snprintf(text, sizeof(text), "%.2f", r.nodes_visited);
+		return text;
+	}
+
+	// The dynamic tree only finds fattened boxes, these test the objects inside them
+
+	void query_dynamic(const dynamic_bvh& tree, vector<object_2d>& objects, vec2 point, vector<object_2d*>& out)
+	{
+		tree.query(point, [&](dynamic_bvh::handle h)
+		{
+			auto& o = objects[tree.user_data(h)];
+			const vec2 d = point - o.position;
+			if (dot(d, d) < o.radius * o.radius)
+				out.push_back(&o);
+			return true;
+		});
+	}
+
+	void query_dynamic(const dynamic_bvh& tree, vector<object_2d>& objects, const aabb& range, vector<object_2d*>& out)
+	{
+		tree.query(range, [&](dynamic_bvh::handle h)
+		{
+			auto& o = objects[tree.user_data(h)];
+			if (range.distance_squared(o.position) < o.radius * o.radius)
+				out.push_back(&o);
+			return true;
+		});
+	}
+
+	void print(const vector<row>& rows, bool json)
+	{
+		if (json)
+		{
+			printf("[\n");
+			for (size_t i = 0; i < rows.size(); i++)
+			{
+				const auto& r = rows[i];
+				printf(
+					"  {\"distribution\": \"%s\", \"objects\": %zu, \"index\": \"%s\", \"operation\": \"%s\", "
+					"\"samples\": %zu, \"min_us\": %.3f, \"median_us\": %.3f, \"p99_us\": %.3f, "
+					"\"nodes_visited\": %s, \"bytes\": %zu, \"results\": %.2f}%s\n",
+					r.distribution.c_str(), r.objects, r.index.c_str(), r.operation.c_str(),
+					r.samples, r.min, r.median, r.p99, nodes_visited(r, "null").c_str(), r.bytes, r.results,
+					i + 1 < rows.size() ? "," : "");
+			}
+			printf("]\n");
+		}
+		else
+		{
+			printf("distribution,objects,index,operation,samples,min_us,median_us,p99_us,nodes_visited,bytes,results\n");
+			for (const auto& r : rows)
+			{
+				printf("%s,%zu,%s,%s,%zu,%.3f,%.3f,%.3f,%s,%zu,%.2f\n",
+					r.distribution.c_str(), r.objects, r.index.c_str(), r.operation.c_str(),
+					r.samples, r.min, r.median, r.p99, nodes_visited(r, "").c_str(), r.bytes, r.results);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	settings s;
+	if (!parse(argc, argv, s))
+	{
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	thread_pool pool(s.threads);
+	broadphase pairs_finder(&pool);
+	vector<row> rows;
+	bool valid = true;
+
+	fprintf(stderr, "threads: %u, simd: %s\n", pool.thread_count(), simd_level_name(detect_simd_level()));
+
+	for (const auto& distribution : s.distributions)
+	{
+		for (const auto count : s.sizes)
+		{
+			fprintf(stderr, "%s %zu\n", distribution.c_str(), count);
+			scene sc = generate(distribution, count, s.seed);
+			auto& objects = sc.objects;
+
+			// Same queries for every index
+			mt19937 random(s.seed + 1);
+			uniform_real_distribution<float> unit(0.0f, 1.0f);
+			vector<vec2> points(s.queries);
+			vector<aabb> ranges(s.queries);
+			const vec2 range_extent(4.0f * sc.mean_radius);
+			for (size_t i = 0; i < s.queries; i++)
+			{
+				points[i] = vec2(unit(random), unit(random)) * sc.size;
+				const vec2 center = vec2(unit(random), unit(random)) * sc.size;
+				ranges[i] = aabb(center - range_extent, center + range_extent);
+			}
+
+			const bool brute_force = count <= s.brute_force_limit;
+			const bool brute_force_pairs = count <= s.brute_force_pairs_limit;
+
+			vector<vector<object_2d*>> point_reference;
+			vector<vector<object_2d*>> range_reference;
+			vector<object_pair> pairs_reference;
+			vector<object_2d*> everything;
+			if (s.validate && brute_force)
+			{
+				for (auto p : points)
+					point_reference.push_back(GetOverlapping(objects, p));
+				for (const auto& r : ranges)
+					range_reference.push_back(GetOverlapping(objects, r));
+			}
+			if (s.validate)
+			{
+				for (auto& o : objects)
+					everything.push_back(&o);
+			}
+			if (s.validate && brute_force_pairs)
+			{
+				find_pairs_brute_force(objects, pairs_reference);
+				sort(pairs_reference.begin(), pairs_reference.end());
+			}
+
+			unique_ptr<bvh> sah_tree;
+			unique_ptr<bvh> median_tree;
+			unique_ptr<bvh4> wide_tree;
+			bvh_build_options sah_options;
+			sah_options.pool = &pool;
+			bvh_build_options median_options = sah_options;
+			median_options.split = bvh_split::median;
+
+			unique_ptr<spatial_index> brute_force_objects(new brute_force_index(objects));
+			unique_ptr<spatial_index> grid;
+
+			// Indices behind the common interface write into a buffer that can hold every object
+			vector<object_2d*> buffer(count);
+			auto add_index = [&](const string& name, unique_ptr<spatial_index>& index, function<spatial_index*()> create)
+			{
+				index_runner r;
+				r.name = name;
+				if (create)
+					r.build = [&index, create] { index.reset(create()); };
+				r.bytes = [&index] { return index->memory_usage(); };
+				r.point = [&index, &buffer](vec2 p, vector<object_2d*>& out)
+				{
+					const auto found = std::min(index->get_overlap(p, buffer.data(), buffer.size()), buffer.size());
+					out.assign(buffer.begin(), buffer.begin() + found);
+				};
+				r.range = [&index, &buffer](const aabb& range, vector<object_2d*>& out)
+				{
+					const auto found = std::min(index->get_overlap(range, buffer.data(), buffer.size()), buffer.size());
+					out.assign(buffer.begin(), buffer.begin() + found);
+				};
+				return r;
+			};
+
+			vector<index_runner> indices;
+			if (brute_force)
+			{
+				index_runner r = add_index("brute_force", brute_force_objects, nullptr);
+				if (brute_force_pairs)
+				{
+					r.pairs = [&](vector<object_pair>& pairs) { find_pairs_brute_force(objects, pairs); };
+				}
+				indices.push_back(r);
+			}
+			indices.push_back(add_index("grid", grid, [&] { return new uniform_grid(objects); }));
+
+			auto add_bvh = [&](const string& name, unique_ptr<bvh>& tree, const bvh_build_options& options)
+			{
+				index_runner r;
+				r.name = name;
+				r.build = [&tree, &objects, &options] { tree.reset(new bvh(objects, options)); };
+				r.bytes = [&tree] { return tree->memory_usage(); };
+				r.point = [&tree](vec2 p, vector<object_2d*>& out)
+				{
+					tree->query_point(p, [&](object_2d& o) { out.push_back(&o); return true; });
+				};
+				r.range = [&tree](const aabb& range, vector<object_2d*>& out)
+				{
+					tree->query_range(range, [&](object_2d& o) { out.push_back(&o); return true; });
+				};
+				r.point_nodes = [&tree](vec2 p)
+				{
+					size_t nodes = 0;
+					tree->query_point(p, [](object_2d&) { return true; }, bvh_count_trace{ nodes });
+					return nodes;
+				};
+				r.range_nodes = [&tree](const aabb& range)
+				{
+					size_t nodes = 0;
+					tree->query_range(range, [](object_2d&) { return true; }, bvh_count_trace{ nodes });
+					return nodes;
+				};
+				r.pairs = [&tree, &pairs_finder](vector<object_pair>& pairs) { pairs_finder.find_pairs(*tree, pairs); };
+				indices.push_back(r);
+			};
+			add_bvh("bvh_sah", sah_tree, sah_options);
+			add_bvh("bvh_median", median_tree, median_options);
+
+			{
+				index_runner r;
+				r.name = "bvh4";
+				r.build = [&] { wide_tree.reset(new bvh4(*sah_tree)); };
+				r.bytes = [&] { return wide_tree->memory_usage(); };
+				r.point = [&](vec2 p, vector<object_2d*>& out) { wide_tree->get_overlap(p, out); };
+				r.point_packet = [&](const vec2* p, size_t n, vector<object_2d*>* out) { wide_tree->get_overlap(p, n, out); };
+				r.point_nodes = [&](vec2 p) { return wide_tree->nodes_visited(p); };
+				indices.push_back(r);
+			}
+
+			// Compressed from the sah tree, so the build time is just the compression
+			unique_ptr<spatial_index> compressed_tree;
+			{
+				index_runner r = add_index("bvh_compressed", compressed_tree, [&] { return new compressed_bvh(*sah_tree); });
+				auto tree = [&compressed_tree] { return static_cast<const compressed_bvh*>(compressed_tree.get()); };
+				r.point_nodes = [tree](vec2 p)
+				{
+					size_t nodes = 0;
+					tree()->query_point(p, [](object_2d&) { return true; }, bvh_count_trace{ nodes });
+					return nodes;
+				};
+				r.range_nodes = [tree](const aabb& range)
+				{
+					size_t nodes = 0;
+					tree()->query_range(range, [](object_2d&) { return true; }, bvh_count_trace{ nodes });
+					return nodes;
+				};
+				indices.push_back(r);
+			}
+
+			// Built by inserting the objects one at a time
+			unique_ptr<dynamic_bvh> dynamic_tree;
+			vector<dynamic_bvh::handle> handles;
+			{
+				index_runner r;
+				r.name = "dynamic_bvh";
+				r.build = [&]
+				{
+					dynamic_tree.reset(new dynamic_bvh());
+					handles.clear();
+					for (size_t i = 0; i < objects.size(); i++)
+					{
+						aabb box;
+						box.add(objects[i]);
+						handles.push_back(dynamic_tree->insert(box, uint32_t(i)));
+					}
+				};
+				r.bytes = [&] { return dynamic_tree->memory_usage(); };
+				r.point = [&](vec2 p, vector<object_2d*>& out) { query_dynamic(*dynamic_tree, objects, p, out); };
+				r.range = [&](const aabb& range, vector<object_2d*>& out) { query_dynamic(*dynamic_tree, objects, range, out); };
+				indices.push_back(r);
+			}
+
+			for (auto& index : indices)
+			{
+				row base = { distribution, count, index.name, "", 0, 0.0, 0.0, 0.0, false, 0.0, 0, 0.0 };
+				vector<double> samples;
+
+				if (index.build)
+				{
+					for (size_t i = 0; i < s.repeats; i++)
+					{
+						const auto t1 = clock_type::now();
+						index.build();
+						const auto t2 = clock_type::now();
+						samples.push_back(microseconds(t1, t2));
+					}
+					row r = base;
+					r.operation = "build";
+					r.bytes = index.bytes();
+					summarize(samples, r);
+					rows.push_back(r);
+				}
+				base.bytes = index.bytes();
+
+				vector<object_2d*> found;
+				found.reserve(count);
+
+				auto run_queries = [&](const char* operation, auto& queries, auto& query, auto& nodes, auto& reference)
+				{
+					if (!query)
+						return;
+					row r = base;
+					r.operation = operation;
+					samples.clear();
+					size_t results = 0;
+					size_t visited = 0;
+					for (size_t i = 0; i < queries.size(); i++)
+					{
+						found.clear();
+						const auto t1 = clock_type::now();
+						query(queries[i], found);
+						const auto t2 = clock_type::now();
+						samples.push_back(microseconds(t1, t2));
+						results += found.size();
+
+						if (nodes)
+							visited += nodes(queries[i]);
+						if (!reference.empty() && !same(found, reference[i]))
+						{
+							fprintf(stderr, "mismatch: %s %s query %zu\n", index.name.c_str(), operation, i);
+							valid = false;
+						}
+					}
+					summarize(samples, r);
+					if (!queries.empty())
+					{
+						r.results = double(results) / double(queries.size());
+						r.counts_nodes = bool(nodes);
+						r.nodes_visited = double(visited) / double(queries.size());
+					}
+					rows.push_back(r);
+				};
+				run_queries("point", points, index.point, index.point_nodes, point_reference);
+
+				// Packets of eight points, each sample is the time per point of one call
+				if (index.point_packet)
+				{
+					const size_t packet_size = 8;
+					vector<vector<object_2d*>> packet_found(packet_size);
+					row r = base;
+					r.operation = "point_packet";
+					samples.clear();
+					size_t results = 0;
+					for (size_t from = 0; from < points.size(); from += packet_size)
+					{
+						const size_t lanes = std::min(points.size() - from, packet_size);
+						for (auto& f : packet_found)
+							f.clear();
+						const auto t1 = clock_type::now();
+						index.point_packet(&points[from], lanes, packet_found.data());
+						const auto t2 = clock_type::now();
+						samples.push_back(microseconds(t1, t2) / double(lanes));
+
+						for (size_t i = 0; i < lanes; i++)
+						{
+							results += packet_found[i].size();
+							if (!point_reference.empty() && !same(packet_found[i], point_reference[from + i]))
+							{
+								fprintf(stderr, "mismatch: %s point_packet query %zu\n", index.name.c_str(), from + i);
+								valid = false;
+							}
+						}
+					}
+					summarize(samples, r);
+					if (!points.empty())
+						r.results = double(results) / double(points.size());
+					rows.push_back(r);
+				}
+
+				run_queries("range", ranges, index.range, index.range_nodes, range_reference);
+
+				// A range larger than any scene has to find every object, whatever the index does with huge coordinates
+				if (s.validate && index.range)
+				{
+					found.clear();
+					index.range(aabb(vec2(-FLT_MAX), vec2(FLT_MAX)), found);
+					if (!same(found, everything))
+					{
+						fprintf(stderr, "mismatch: %s huge range query\n", index.name.c_str());
+						valid = false;
+					}
+				}
+
+				if (index.pairs)
+				{
+					vector<object_pair> pairs;
+					samples.clear();
+					for (size_t i = 0; i < s.repeats; i++)
+					{
+						const auto t1 = clock_type::now();
+						index.pairs(pairs);
+						const auto t2 = clock_type::now();
+						samples.push_back(microseconds(t1, t2));
+					}
+					row r = base;
+					r.operation = "pairs";
+					r.results = double(pairs.size());
+					summarize(samples, r);
+					rows.push_back(r);
+
+					if (s.validate && brute_force_pairs)
+					{
+						sort(pairs.begin(), pairs.end());
+						if (pairs != pairs_reference)
+						{
+							fprintf(stderr, "mismatch: %s pairs\n", index.name.c_str());
+							valid = false;
+						}
+					}
+				}
+			}
+
+			// Every repeat moves each object a small step of its own, up to half the
+			// mean radius, so they drift out of their fattened boxes over the repeats. The dynamic
+			// tree follows them with move, a copy of it with refit_all, and for
+			// comparison a new bvh is built over the moved objects.
+			{
+				vector<object_2d> moved = objects;
+				vector<vec2> displacement(count);
+				uniform_real_distribution<float> angle(0.0f, 2.0f * 3.14159265f);
+				for (auto& d : displacement)
+				{
+					const float a = angle(random);
+					d = vec2(cos(a), sin(a)) * (0.5f * sc.mean_radius * unit(random));
+				}
+				dynamic_bvh refit_tree = *dynamic_tree;
+				unique_ptr<bvh> rebuilt;
+
+				vector<double> move_samples;
+				vector<double> refit_samples;
+				vector<double> rebuild_samples;
+				size_t reinserts = 0;
+				for (size_t i = 0; i < s.repeats; i++)
+				{
+					for (size_t j = 0; j < count; j++)
+						moved[j].position += displacement[j];
+
+					auto t1 = clock_type::now();
+					for (size_t j = 0; j < count; j++)
+					{
+						aabb box;
+						box.add(moved[j]);
+						if (dynamic_tree->move(handles[j], box, displacement[j]))
+							reinserts++;
+					}
+					auto t2 = clock_type::now();
+					move_samples.push_back(microseconds(t1, t2));
+
+					t1 = clock_type::now();
+					refit_tree.refit_all([&](uint32_t j)
+					{
+						aabb box;
+						box.add(moved[j]);
+						return box;
+					});
+					t2 = clock_type::now();
+					refit_samples.push_back(microseconds(t1, t2));
+
+					t1 = clock_type::now();
+					rebuilt.reset(new bvh(moved, sah_options));
+					t2 = clock_type::now();
+					rebuild_samples.push_back(microseconds(t1, t2));
+				}
+
+				row base = { distribution, count, "dynamic_bvh", "", 0, 0.0, 0.0, 0.0, false, 0.0, dynamic_tree->memory_usage(), 0.0 };
+				row r = base;
+				r.operation = "move";
+				r.results = double(reinserts) / double(s.repeats);
+				summarize(move_samples, r);
+				rows.push_back(r);
+
+				r = base;
+				r.operation = "refit";
+				r.bytes = refit_tree.memory_usage();
+				summarize(refit_samples, r);
+				rows.push_back(r);
+
+				r = base;
+				r.index = "bvh_sah";
+				r.operation = "rebuild";
+				r.bytes = rebuilt->memory_usage();
+				summarize(rebuild_samples, r);
+				rows.push_back(r);
+
+				if (s.validate && brute_force)
+				{
+					auto check = [&](const dynamic_bvh& tree, const char* update)
+					{
+						vector<object_2d*> found;
+						for (size_t i = 0; i < points.size(); i++)
+						{
+							found.clear();
+							query_dynamic(tree, moved, points[i], found);
+							if (!same(found, GetOverlapping(moved, points[i])))
+							{
+								fprintf(stderr, "mismatch: dynamic_bvh after %s point query %zu\n", update, i);
+								valid = false;
+							}
+						}
+						for (size_t i = 0; i < ranges.size(); i++)
+						{
+							found.clear();
+							query_dynamic(tree, moved, ranges[i], found);
+							if (!same(found, GetOverlapping(moved, ranges[i])))
+							{
+								fprintf(stderr, "mismatch: dynamic_bvh after %s range query %zu\n", update, i);
+								valid = false;
+							}
+						}
+					};
+					check(*dynamic_tree, "move");
+					check(refit_tree, "refit");
+				}
+			}
+		}
+	}
+
+	print(rows, s.json);
+
+	if (s.validate)
+		fprintf(stderr, valid ? "validation passed\n" : "validation FAILED\n");
+	return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,214 +3,21 @@
 #include <glm.hpp>
 #include <vector>
 #include "source/defines.h"
+#include "source/bvh.h"
+#include "source/profiler.h"
+#include "source/render.h"
+#include "source/spatial_index.h"
 #include <chrono>
 #include <string>
 #include <algorithm>
+#include <memory>
 
-const float pi = 3.14159265359f;
 const int w = 1280;
 const int h = 720;
 
 using namespace glm;
 using namespace std;
 
-SDL_Renderer* renderer = nullptr;
-
-struct object_2d
-{
-	vec2 position;
-	float radius;
-	SDL_Color color;
-};
-
-void RenderDrawCircle(SDL_Renderer * renderer,
-	vec2 center,
-	float radius)
-{
-	const int n = 12;
-	float t = 0.0f;
-	const float dt = 2.0f * pi / float(n);
-	for(int i = 0; i < n; i++)
-	{
-		SDL_RenderDrawLine(renderer,
-			int(center.x + cos(t) * radius),
-			int(center.y + sin(t) * radius),
-			int(center.x + cos(t+dt) * radius),
-			int(center.y + sin(t+dt) * radius));
-		t += dt;
-	}
-}
-
-void RenderLine(vec2 a, vec2 b)
-{
-	SDL_RenderDrawLine(renderer, int(a.x), int(a.y), int(b.x), int(b.y));
-}
-
-void RenderBox(vec2 min, vec2 max)
-{
-	const vec2 A(min.x, min.y);
-	const vec2 B(max.x, min.y);
-	const vec2 D(min.x, max.y);
-	const vec2 C(max.x, max.y);
-	RenderLine(A, B);
-	RenderLine(B, C);
-	RenderLine(C, D);
-	RenderLine(D, A);
-}
-
-std::vector<object_2d*> GetOverlapping(std::vector<object_2d>& objects, vec2& point)
-{
-	std::vector<object_2d*> overlap;
-	for(auto& o : objects)
-	{
-		vec2 d = point - o.position;
-		if (length(d) < o.radius)
-			overlap.push_back(&o);
-	}
-	return overlap;
-}
-
-struct aabb
-{
-	vec2 min;
-	vec2 max;
-
-	aabb() : min(FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX) {}
-	aabb(vec2 min, vec2 max) : min(min), max(max) {}
-	void add(const object_2d& object);
-	void add(const aabb& aabb);
-	bool overlap(const vec2& vec);
-};
-
-void aabb::add(const object_2d& object)
-{
-	vec2 ex(object.radius, object.radius);
-	aabb object_bb;
-	object_bb.min = object.position - ex;
-	object_bb.max = object.position + ex;
-	add(object_bb);
-}
-
-void aabb::add(const aabb& aabb)
-{
-	if (aabb.max.x > max.x)
-		max.x = aabb.max.x;
-	if (aabb.min.x < min.x)
-		min.x = aabb.min.x;
-	
-	if (aabb.max.y > max.y)
-		max.y = aabb.max.y;
-	if (aabb.min.y < min.y)
-		min.y = aabb.min.y;
-}
-
-bool aabb::overlap(const vec2& vec)
-{
-	return
-		(min.x <= vec.x) && (min.y <= vec.y) &&
-		(max.x >= vec.x) && (max.y >= vec.y);
-}
-
-class bvh
-{
-public:
-	bvh(std::vector<object_2d>& bodies);
-	std::vector<object_2d*> get_overlap(vec2 pos);
-	void draw();
-private:	
-	struct bvh_node
-	{
-		object_2d* object		= nullptr;
-		aabb bounding_box;		
-		bvh_node* left			= nullptr;
-		bvh_node* right			= nullptr;
-	};
-	void recurse(size_t from, size_t to, bvh_node* parent, int depth);
-	void draw(bvh_node* node);
-
-	void get_overlap(vec2 pos, std::vector<object_2d*>& overlap, bvh_node* node);
-
-	bvh_node*				_root		= nullptr;
-	std::vector<object_2d*>	_bodies;
-};
-
-bvh::bvh(std::vector<object_2d>& bodies)
-{
-	_bodies.reserve(bodies.size());
-	for (auto& b : bodies)
-		_bodies.push_back(&b);
-
-	_root = new bvh_node();
-	recurse(0, _bodies.size() - 1, _root, 0);
-}
-
-std::vector<object_2d*> bvh::get_overlap(vec2 pos)
-{
-	std::vector<object_2d*> overlap;
-	get_overlap(pos, overlap, _root);
-	return overlap;
-}
-
-void bvh::draw()
-{
-	draw(_root);
-}
-
-void bvh::recurse(size_t from, size_t to, bvh_node* parent, int depth)
-{
-	if (from >= to)
-	{
-		parent->object = _bodies[from];
-		parent->bounding_box.add(*parent->object);
-	}
-	else
-	{
-		static auto sort_x = [](object_2d* body0, object_2d* body1)
-		{ return body0->position.x > body1->position.x; };
-
-		static auto sort_y = [](object_2d* body0, object_2d* body1)
-		{ return body0->position.y > body1->position.y; };
-
-		if (depth % 2)
-			sort(_bodies.begin() + from, _bodies.begin() + to, sort_x);
-		else
-			sort(_bodies.begin() + from, _bodies.begin() + to, sort_y);
-
-		parent->left = new bvh_node();
-		parent->right = new bvh_node();
-		const auto len = to - from;
-		recurse(from, from + len / 2, parent->left, depth + 1);
-		recurse(from + len / 2 + 1, to, parent->right, depth + 1);
-
-		parent->bounding_box.add(parent->left->bounding_box);
-		parent->bounding_box.add(parent->right->bounding_box);
-	}
-}
-
-void bvh::draw(bvh_node* node)
-{
-	RenderBox(node->bounding_box.min, node->bounding_box.max);
-	
-	if (node->left)
-		draw(node->left);
-	if (node->right)
-		draw(node->right);
-}
-
-void bvh::get_overlap(vec2 pos, std::vector<object_2d*>& overlap, bvh_node* node)
-{
-	if(node->bounding_box.overlap(pos))
-	{
-		RenderBox(node->bounding_box.min, node->bounding_box.max);
-		if (node->left)
-			get_overlap(pos, overlap, node->left);		
-		if (node->right)
-			get_overlap(pos, overlap, node->right);
-		if (node->object)
-			overlap.push_back(node->object);
-	}
-}
-
 int main(int argc, char** argv)
 {
 	SDL_Window* window = NULL;
@@ -248,53 +55,113 @@ int main(int argc, char** argv)
 		objects.push_back(ob);
 	}
 
-	bvh bvh_tree(objects);
+	// Keys 1 to 4 switch between the indices
+	std::vector<std::unique_ptr<spatial_index>> indices;
+	indices.push_back(create_spatial_index(spatial_index_type::brute_force, objects));
+	std::unique_ptr<bvh> tree;
+	{
+		PROFILE_ZONE("bvh build");
+		tree.reset(new bvh(objects));
+	}
+	const bvh* culling = tree.get();
+	indices.push_back(std::move(tree));
+	indices.push_back(create_spatial_index(spatial_index_type::grid, objects));
+	indices.push_back(create_spatial_index(spatial_index_type::compressed_bvh, objects));
+	spatial_index* index = indices[1].get();
+
+	std::vector<object_2d*> overlap(objects.size());
+	std::vector<aabb> visited;
+	render_batch batch;
+
+	// Slightly larger than the window so outlines on the edge are kept
+	const aabb view(vec2(-2.0f, -2.0f), vec2(float(w) + 2.0f, float(h) + 2.0f));
 	
 	SDL_Event event;
 	bool quit = false;
 
 	while (!quit)
 	{
-		while (SDL_PollEvent(&event))
-			if (event.type == SDL_QUIT)
-				quit = true;
+		// The frame zone closes before the delay, so it only measures the work
+		{
+			PROFILE_ZONE("frame");
 
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-		SDL_RenderClear(renderer);
+			while (SDL_PollEvent(&event))
+			{
+				if (event.type == SDL_QUIT)
+				{
+					quit = true;
+				}
+				else if (event.type == SDL_KEYDOWN)
+				{
+					const auto key = event.key.keysym.sym;
+					if (key >= SDLK_1 && key < SDLK_1 + int(indices.size()))
+						index = indices[key - SDLK_1].get();
+					else if (key == SDLK_p)
+						profiler::shared().export_trace("profile.json");
+				}
+			}
+
+			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+			SDL_RenderClear(renderer);
 
-		for (auto& o : objects)
-		{
-			SDL_SetRenderDrawColor(renderer, o.color.r, o.color.g, o.color.b, 255);
-			RenderDrawCircle(renderer, o.position, o.radius);
-		}
+			{
+				PROFILE_ZONE("cull");
+				culling->query_range(view, [&](object_2d& o)
+				{
+					batch.circle(o.position, o.radius, { o.color.r, o.color.g, o.color.b, 255 });
+					return true;
+				});
+			}
+
+			int x;
+			int y;
+			SDL_GetMouseState(&x, &y);
+			auto mouse = vec2(x, y);
+
+			// Measure the time for this call and make it faster. You can output the value in the title of the window
+			auto t1 = std::chrono::high_resolution_clock::now();
+			size_t count;
+			{
+				PROFILE_ZONE("query");
+				count = std::min(index->get_overlap(mouse, overlap.data(), overlap.size()), overlap.size());
+			}
+			auto t2 = std::chrono::high_resolution_clock::now();
+			auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
 
-		int x;
-		int y;
-		SDL_GetMouseState(&x, &y);
-		auto mouse = vec2(x, y);
+			string name = string(index->name()) + " cast time: " + std::to_string(duration);
+			SDL_SetWindowTitle(window, name.c_str());
 
-		// Measure the time for this call and make it faster. You can output the value in the title of the window
-		auto t1 = std::chrono::high_resolution_clock::now();
-		//auto overlap = GetOverlapping(objects, mouse);
-		auto overlap = bvh_tree.get_overlap(mouse);
-		auto t2 = std::chrono::high_resolution_clock::now();
-		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+			// Query again, outside of the measurement, to draw the nodes it visits
+			if (auto tree = dynamic_cast<bvh*>(index))
+			{
+				visited.clear();
+				tree->query_point(mouse, [](object_2d&) { return true; }, bvh_box_trace{ visited });
+				for (auto& box : visited)
+					batch.box(box.min, box.max, { 96, 96, 96, 255 });
+			}
 
-		string name = "Cast time: " + std::to_string(duration);
-		SDL_SetWindowTitle(window, name.c_str());
+			for (size_t i = 0; i < count; i++)
+			{
+				auto o = overlap[i];
+				const float rings[] = { o->radius - 1.6f, o->radius - 0.8f, o->radius + 0.8f, o->radius + 1.6f };
+				batch.circles(o->position, rings, 4, { o->color.r, o->color.g, o->color.b, 255 });
+			}
 		
-		for (auto& o : overlap)
-		{
-			SDL_SetRenderDrawColor(renderer, o->color.r, o->color.g, o->color.b, 255);
-			RenderDrawCircle(renderer, o->position, o->radius+0.8f);
-			RenderDrawCircle(renderer, o->position, o->radius-0.8f);
-			RenderDrawCircle(renderer, o->position, o->radius+1.6f);
-			RenderDrawCircle(renderer, o->position, o->radius-1.6f);
+			batch.circle(mouse, 6.0f, { 255, 255, 255, 255 });
+			{
+				PROFILE_ZONE("render");
+				batch.flush(renderer);
+	#if PROFILER_ENABLED
+				profiler::shared().draw_overlay(renderer, 8, 8);
+	#endif
+			}
+
+			{
+				PROFILE_ZONE("present");
+				SDL_RenderPresent(renderer);
+			}
 		}
-		
-		RenderDrawCircle(renderer, mouse,6.0f);
-		
-		SDL_RenderPresent(renderer);
+
 		SDL_Delay(1000 / 30);
 	}
 
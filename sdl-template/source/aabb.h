@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cfloat>
+#include <glm.hpp>
+#include "object_2d.h"
+
+/// Axis aligned bounding box, empty (inverted) by default
+struct aabb
+{
+	glm::vec2 min;
+	glm::vec2 max;
+
+	aabb() : min(FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX) {}
+	aabb(glm::vec2 min, glm::vec2 max) : min(min), max(max) {}
+	void add(const glm::vec2& position, float radius);
+	void add(const object_2d& object);
+	void add(const aabb& aabb);
+	bool overlap(const glm::vec2& vec) const;
+	bool overlap(const aabb& other) const;
+	bool contains(const aabb& other) const;
+	float perimeter() const;
+	float distance_squared(const glm::vec2& point) const;
+};
+
+inline void aabb::add(const glm::vec2& position, float radius)
+{
+	const glm::vec2 ex(radius, radius);
+	add(aabb(position - ex, position + ex));
+}
+
+inline void aabb::add(const object_2d& object)
+{
+	add(object.position, object.radius);
+}
+
+inline void aabb::add(const aabb& aabb)
+{
+	if (aabb.max.x > max.x)
+		max.x = aabb.max.x;
+	if (aabb.min.x < min.x)
+		min.x = aabb.min.x;
+
+	if (aabb.max.y > max.y)
+		max.y = aabb.max.y;
+	if (aabb.min.y < min.y)
+		min.y = aabb.min.y;
+}
+
+inline bool aabb::overlap(const glm::vec2& vec) const
+{
+	return
+		(min.x <= vec.x) && (min.y <= vec.y) &&
+		(max.x >= vec.x) && (max.y >= vec.y);
+}
+
+inline bool aabb::overlap(const aabb& other) const
+{
+	return
+		(min.x <= other.max.x) && (min.y <= other.max.y) &&
+		(max.x >= other.min.x) && (max.y >= other.min.y);
+}
+
+inline bool aabb::contains(const aabb& other) const
+{
+	return
+		(min.x <= other.min.x) && (min.y <= other.min.y) &&
+		(max.x >= other.max.x) && (max.y >= other.max.y);
+}
+
+inline float aabb::perimeter() const
+{
+	return 2.0f * ((max.x - min.x) + (max.y - min.y));
+}
+
+inline float aabb::distance_squared(const glm::vec2& point) const
+{
+	const glm::vec2 d = glm::max(glm::max(min - point, point - max), glm::vec2(0.0f));
+	return glm::dot(d, d);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/// Allocator that aligns the storage to Align bytes. Before C++17 the
+/// standard allocator ignores alignas above 16, so containers of cache line
+/// sized nodes need this to keep each node on a single line.
+template <typename T, size_t Align>
+class aligned_allocator
+{
+public:
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = aligned_allocator<U, Align>;
+	};
+
+	aligned_allocator() = default;
+
+	template <typename U>
+	aligned_allocator(const aligned_allocator<U, Align>&) {}
+
+	/// Allocates with malloc and keeps the original pointer just before the aligned block
+	T* allocate(size_t count)
+	{
+		if (count > (SIZE_MAX - Align - sizeof(void*)) / sizeof(T))
+			throw std::bad_alloc();
+
+		void* raw = malloc(count * sizeof(T) + Align + sizeof(void*));
+		if (!raw)
+			throw std::bad_alloc();
+
+		const uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+		const uintptr_t aligned = (start + Align - 1) & ~uintptr_t(Align - 1);
+		reinterpret_cast<void**>(aligned)[-1] = raw;
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	void deallocate(T* pointer, size_t)
+	{
+		if (pointer)
+			free(reinterpret_cast<void**>(pointer)[-1]);
+	}
+
+	template <typename U>
+	bool operator==(const aligned_allocator<U, Align>&) const { return true; }
+
+	template <typename U>
+	bool operator!=(const aligned_allocator<U, Align>&) const { return false; }
+
+	static_assert((Align & (Align - 1)) == 0, "alignment has to be a power of two");
+};
@@ -0,0 +1,184 @@
+#include "broadphase.h"
+#include <algorithm>
+#include "growable_stack.h"
+#include "thread_pool.h"
+
+using namespace glm;
+
+namespace
+{
+	void test_pair(const bvh::primitive& p0, const bvh::primitive& p1, std::vector<object_pair>& pairs)
+	{
+		const vec2 d = p0.position - p1.position;
+		const float r = p0.radius + p1.radius;
+		if (dot(d, d) < r * r)
+		{
+			if (p0.index < p1.index)
+				pairs.push_back({ p0.index, p1.index });
+			else
+				pairs.push_back({ p1.index, p0.index });
+		}
+	}
+}
+
+broadphase::broadphase(thread_pool* pool) :
+	_pool(pool ? pool : &thread_pool::shared())
+{}
+
+void broadphase::find_pairs(const bvh& tree, std::vector<object_pair>& pairs)
+{
+	pairs.clear();
+	if (tree.nodes().empty())
+		return;
+
+	// Enough jobs per thread to even out the uneven amount of work in each
+	const size_t job_count = size_t(_pool->thread_count()) * 4;
+	split_tasks(tree, job_count * 4);
+
+	const size_t jobs = std::min(job_count, _tasks.size());
+	if (_buffers.size() < jobs)
+		_buffers.resize(jobs);
+
+	task_group group;
+	for (size_t j = 0; j < jobs; j++)
+	{
+		_pool->run(group, [this, &tree, j, jobs]
+		{
+			auto& buffer = _buffers[j];
+			buffer.clear();
+			for (size_t t = j; t < _tasks.size(); t += jobs)
+				run(tree, _tasks[t], buffer);
+		});
+	}
+	_pool->wait(group);
+
+	size_t total = 0;
+	for (size_t j = 0; j < jobs; j++)
+		total += _buffers[j].size();
+	pairs.reserve(total);
+	for (size_t j = 0; j < jobs; j++)
+		pairs.insert(pairs.end(), _buffers[j].begin(), _buffers[j].end());
+}
+
+void broadphase::split_tasks(const bvh& tree, size_t target)
+{
+	const auto& nodes = tree.nodes();
+	_tasks.clear();
+	_tasks.push_back({ 0, 0 });
+
+	// Open up the descent one level at a time until there is enough to share.
+	// Subtrees that can't be opened further are carried over as they are.
+	bool opened = true;
+	while (opened && _tasks.size() < target)
+	{
+		opened = false;
+		_next.clear();
+		for (const auto& t : _tasks)
+		{
+			const auto& a = nodes[t.a];
+			const auto& b = nodes[t.b];
+			if (t.a == t.b)
+			{
+				if (a.count)
+				{
+					_next.push_back(t);
+					continue;
+				}
+				_next.push_back({ t.a + 1, t.a + 1 });
+				_next.push_back({ a.right, a.right });
+				_next.push_back({ t.a + 1, a.right });
+				opened = true;
+			}
+			else
+			{
+				if (!a.bounding_box.overlap(b.bounding_box))
+					continue;
+				if (a.count && b.count)
+				{
+					_next.push_back(t);
+					continue;
+				}
+				if (b.count || (!a.count && a.bounding_box.perimeter() >= b.bounding_box.perimeter()))
+				{
+					_next.push_back({ t.a + 1, t.b });
+					_next.push_back({ a.right, t.b });
+				}
+				else
+				{
+					_next.push_back({ t.a, t.b + 1 });
+					_next.push_back({ t.a, b.right });
+				}
+				opened = true;
+			}
+		}
+		std::swap(_tasks, _next);
+	}
+}
+
+void broadphase::run(const bvh& tree, task t, std::vector<object_pair>& pairs)
+{
+	const auto& nodes = tree.nodes();
+	const auto& primitives = tree.primitives();
+
+	growable_stack<task, 64> stack;
+	stack.push(t);
+	while (!stack.empty())
+	{
+		t = stack.pop();
+		const auto& a = nodes[t.a];
+		const auto& b = nodes[t.b];
+
+		if (t.a == t.b)
+		{
+			if (a.count)
+			{
+				for (uint32_t i = a.first; i < a.first + a.count; i++)
+					for (uint32_t j = i + 1; j < a.first + a.count; j++)
+						test_pair(primitives[i], primitives[j], pairs);
+			}
+			else
+			{
+				stack.push({ t.a + 1, t.a + 1 });
+				stack.push({ a.right, a.right });
+				stack.push({ t.a + 1, a.right });
+			}
+			continue;
+		}
+
+		if (!a.bounding_box.overlap(b.bounding_box))
+			continue;
+
+		if (a.count && b.count)
+		{
+			for (uint32_t i = a.first; i < a.first + a.count; i++)
+				for (uint32_t j = b.first; j < b.first + b.count; j++)
+					test_pair(primitives[i], primitives[j], pairs);
+		}
+		else if (b.count || (!a.count && a.bounding_box.perimeter() >= b.bounding_box.perimeter()))
+		{
+			// Descend into the larger subtree
+			stack.push({ t.a + 1, t.b });
+			stack.push({ a.right, t.b });
+		}
+		else
+		{
+			stack.push({ t.a, t.b + 1 });
+			stack.push({ t.a, b.right });
+		}
+	}
+}
+
+void find_pairs_brute_force(const std::vector<object_2d>& objects, std::vector<object_pair>& pairs)
+{
+	pairs.clear();
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		for (size_t j = i + 1; j < objects.size(); j++)
+		{
+			const vec2 d = objects[i].position - objects[j].position;
+			const float r = objects[i].radius + objects[j].radius;
+			if (dot(d, d) < r * r)
+				pairs.push_back({ uint32_t(i), uint32_t(j) });
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+
+class thread_pool;
+
+/// Two objects whose circles overlap, as indices into the objects the bvh was
+/// built from. The first index is always the lower one.
+struct object_pair
+{
+	uint32_t a;
+	uint32_t b;
+};
+
+inline bool operator==(const object_pair& p0, const object_pair& p1) { return p0.a == p1.a && p0.b == p1.b; }
+inline bool operator<(const object_pair& p0, const object_pair& p1) { return p0.a < p1.a || (p0.a == p1.a && p0.b < p1.b); }
+
+/// Finds all pairs of overlapping objects by descending a bvh against itself.
+/// The top of the descent is split into independent pieces of work that run
+/// on a thread pool. Every job writes to its own buffer, and the buffers are
+/// joined at the end, so the threads never share anything they write to.
+/// Buffers are kept between calls to avoid allocating every frame.
+class broadphase
+{
+public:
+	/// Uses the shared pool if none is given
+	explicit broadphase(thread_pool* pool = nullptr);
+
+	/// Replaces the contents of pairs with every overlapping pair, in no particular order
+	void find_pairs(const bvh& tree, std::vector<object_pair>& pairs);
+
+private:
+	/// A node against itself when both are the same, otherwise two different subtrees
+	struct task
+	{
+		uint32_t a;
+		uint32_t b;
+	};
+
+	void split_tasks(const bvh& tree, size_t target);
+	static void run(const bvh& tree, task t, std::vector<object_pair>& pairs);
+
+	thread_pool*						_pool;
+	std::vector<task>					_tasks;
+	std::vector<task>					_next;
+	std::vector<std::vector<object_pair>>	_buffers;
+};
+
+/// Reference that tests every pair of objects
+void find_pairs_brute_force(const std::vector<object_2d>& objects, std::vector<object_pair>& pairs);
@@ -0,0 +1,63 @@
+#include "brute_force.h"
+
+using namespace glm;
+
+std::vector<object_2d*> GetOverlapping(std::vector<object_2d>& objects, vec2& point)
+{
+	std::vector<object_2d*> overlap;
+	for(auto& o : objects)
+	{
+		vec2 d = point - o.position;
+		if (dot(d, d) < o.radius * o.radius)
+			overlap.push_back(&o);
+	}
+	return overlap;
+}
+
+std::vector<object_2d*> GetOverlapping(std::vector<object_2d>& objects, const aabb& range)
+{
+	std::vector<object_2d*> overlap;
+	for (auto& o : objects)
+	{
+		if (range.distance_squared(o.position) < o.radius * o.radius)
+			overlap.push_back(&o);
+	}
+	return overlap;
+}
+
+std::vector<object_handle> GetOverlapping(const object_store& objects, const vec2& point)
+{
+	std::vector<object_handle> overlap;
+	objects.query_point(point, [&](object_handle h) { overlap.push_back(h); return true; });
+	return overlap;
+}
+
+std::vector<object_handle> GetOverlapping(const object_store& objects, const aabb& range)
+{
+	std::vector<object_handle> overlap;
+	objects.query_range(range, [&](object_handle h) { overlap.push_back(h); return true; });
+	return overlap;
+}
+
+// Objects were added in order, so the handle index is the index in the vector
+
+size_t brute_force_index::get_overlap(const vec2& point, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { _store.query_point(point, visitor); },
+		overlap, capacity, [&](object_handle h) { return _objects + h.index; });
+}
+
+size_t brute_force_index::get_overlap(const vec2& center, float radius, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { _store.query_circle(center, radius, visitor); },
+		overlap, capacity, [&](object_handle h) { return _objects + h.index; });
+}
+
+size_t brute_force_index::get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { _store.query_range(range, visitor); },
+		overlap, capacity, [&](object_handle h) { return _objects + h.index; });
+}
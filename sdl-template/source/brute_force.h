@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include "aabb.h"
+#include "object_store.h"
+#include "spatial_index.h"
+
+/// Objects containing the point, testing every object
+std::vector<object_2d*> GetOverlapping(std::vector<object_2d>& objects, glm::vec2& point);
+
+/// Objects overlapping the box, testing every object
+std::vector<object_2d*> GetOverlapping(std::vector<object_2d>& objects, const aabb& range);
+
+/// Objects containing the point, scanning the packed arrays a few objects at a time
+std::vector<object_handle> GetOverlapping(const object_store& objects, const glm::vec2& point);
+
+/// Objects overlapping the box, scanning the packed arrays a few objects at a time
+std::vector<object_handle> GetOverlapping(const object_store& objects, const aabb& range);
+
+/// Tests every object, the baseline for the other indices. Scans a copy of
+/// the positions and radii in an object_store, so it is also the fastest
+/// choice for small scenes.
+class brute_force_index : public spatial_index
+{
+public:
+	explicit brute_force_index(std::vector<object_2d>& objects) : _objects(objects.data()), _store(objects) {}
+
+	const char* name() const override { return "brute_force"; }
+	size_t get_overlap(const glm::vec2& point, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const glm::vec2& center, float radius, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const override;
+	size_t memory_usage() const override { return _store.memory_usage(); }
+
+private:
+	object_2d*		_objects;
+	object_store	_store;
+};
@@ -0,0 +1,232 @@
+#include "bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include "thread_pool.h"
+
+using namespace glm;
+
+/// Builds the nodes of a subtree into a vector of its own, with child and skip
+/// indices relative to the start of that vector. Subtrees built in parallel get
+/// appended to their parent afterwards.
+struct bvh::builder
+{
+	const bvh_build_options&	options;
+	std::vector<primitive>&		primitives;
+	thread_pool*				pool;
+
+	void build(uint32_t from, uint32_t to, std::vector<bvh_node>& nodes);
+	uint32_t split(uint32_t from, uint32_t to, const aabb& centroids);
+	uint32_t split_median(uint32_t from, uint32_t to, const aabb& centroids);
+	uint32_t split_sah(uint32_t from, uint32_t to, const aabb& centroids);
+	static void append(std::vector<bvh_node>& nodes, const std::vector<bvh_node>& subtree);
+};
+
+void bvh::builder::build(uint32_t from, uint32_t to, std::vector<bvh_node>& nodes)
+{
+	const auto index = uint32_t(nodes.size());
+	nodes.emplace_back();
+
+	aabb bounding_box;
+	aabb centroids;
+	for (uint32_t i = from; i < to; i++)
+	{
+		bounding_box.add(primitives[i].position, primitives[i].radius);
+		centroids.add(aabb(primitives[i].position, primitives[i].position));
+	}
+	nodes[index].bounding_box = bounding_box;
+
+	if (to - from <= std::max(options.max_leaf_size, 1u))
+	{
+		nodes[index].first = from;
+		nodes[index].count = to - from;
+	}
+	else
+	{
+		const auto mid = split(from, to, centroids);
+		if (pool && to - from >= options.parallel_threshold)
+		{
+			std::vector<bvh_node> left;
+			std::vector<bvh_node> right;
+			task_group group;
+			pool->run(group, [&] { build(from, mid, left); });
+			build(mid, to, right);
+			pool->wait(group);
+
+			append(nodes, left);
+			nodes[index].right = uint32_t(nodes.size());
+			append(nodes, right);
+		}
+		else
+		{
+			build(from, mid, nodes);
+			nodes[index].right = uint32_t(nodes.size());
+			build(mid, to, nodes);
+		}
+	}
+
+	nodes[index].skip = uint32_t(nodes.size());
+}
+
+uint32_t bvh::builder::split(uint32_t from, uint32_t to, const aabb& centroids)
+{
+	// All centers in one spot, any split is as good as the other
+	if (centroids.min == centroids.max)
+		return from + (to - from) / 2;
+
+	if (options.split == bvh_split::sah)
+	{
+		const auto mid = split_sah(from, to, centroids);
+		if (mid > from && mid < to)
+			return mid;
+	}
+	return split_median(from, to, centroids);
+}
+
+uint32_t bvh::builder::split_median(uint32_t from, uint32_t to, const aabb& centroids)
+{
+	const vec2 extent = centroids.max - centroids.min;
+	const int axis = extent.x > extent.y ? 0 : 1;
+	const auto mid = from + (to - from) / 2;
+	std::nth_element(
+		primitives.begin() + from,
+		primitives.begin() + mid,
+		primitives.begin() + to,
+		[axis](const primitive& p0, const primitive& p1)
+		{ return p0.position[axis] < p1.position[axis]; });
+	return mid;
+}
+
+uint32_t bvh::builder::split_sah(uint32_t from, uint32_t to, const aabb& centroids)
+{
+	struct bin
+	{
+		aabb bounding_box;
+		uint32_t count = 0;
+	};
+
+	const uint32_t max_bins = 64;
+	const auto bin_count = std::min(std::max(options.bin_count, 2u), max_bins);
+	bin bins[max_bins];
+	float right_cost[max_bins];
+
+	// In 2D the surface area of a box is its perimeter
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	uint32_t best_bin = 0;
+	for (int axis = 0; axis < 2; axis++)
+	{
+		const float extent = centroids.max[axis] - centroids.min[axis];
+		if (extent <= 0.0f)
+			continue;
+		const float scale = float(bin_count) / extent;
+
+		for (uint32_t b = 0; b < bin_count; b++)
+			bins[b] = bin();
+		for (uint32_t i = from; i < to; i++)
+		{
+			const auto& p = primitives[i];
+			const auto b = std::min(uint32_t((p.position[axis] - centroids.min[axis]) * scale), bin_count - 1);
+			bins[b].count++;
+			bins[b].bounding_box.add(p.position, p.radius);
+		}
+
+		// Sweep from the right to get the cost of everything right of each plane
+		aabb right_box;
+		uint32_t right_count = 0;
+		for (uint32_t b = bin_count - 1; b > 0; b--)
+		{
+			right_box.add(bins[b].bounding_box);
+			right_count += bins[b].count;
+			right_cost[b] = right_count ? right_box.perimeter() * float(right_count) : 0.0f;
+		}
+
+		aabb left_box;
+		uint32_t left_count = 0;
+		for (uint32_t b = 0; b < bin_count - 1; b++)
+		{
+			left_box.add(bins[b].bounding_box);
+			left_count += bins[b].count;
+			if (left_count == 0 || left_count == to - from)
+				continue;
+			const float cost = left_box.perimeter() * float(left_count) + right_cost[b + 1];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	if (best_axis < 0)
+		return from;
+
+	const float scale = float(bin_count) / (centroids.max[best_axis] - centroids.min[best_axis]);
+	const float origin = centroids.min[best_axis];
+	const auto it = std::partition(
+		primitives.begin() + from,
+		primitives.begin() + to,
+		[=](const primitive& p)
+		{ return std::min(uint32_t((p.position[best_axis] - origin) * scale), bin_count - 1) <= best_bin; });
+	return uint32_t(it - primitives.begin());
+}
+
+void bvh::builder::append(std::vector<bvh_node>& nodes, const std::vector<bvh_node>& subtree)
+{
+	const auto offset = uint32_t(nodes.size());
+	for (auto node : subtree)
+	{
+		if (node.count == 0)
+			node.right += offset;
+		node.skip += offset;
+		nodes.push_back(node);
+	}
+}
+
+bvh::bvh(std::vector<object_2d>& bodies, const bvh_build_options& options)
+{
+	_objects = bodies.data();
+	_primitives.reserve(bodies.size());
+	for (size_t i = 0; i < bodies.size(); i++)
+		_primitives.push_back({ bodies[i].position, bodies[i].radius, uint32_t(i) });
+
+	if (_primitives.empty())
+		return;
+
+	thread_pool* pool = nullptr;
+	if (options.parallel)
+		pool = options.pool ? options.pool : &thread_pool::shared();
+
+	builder b = { options, _primitives, pool };
+	_nodes.reserve(2 * _primitives.size() / std::max(options.max_leaf_size, 1u) + 1);
+	b.build(0, uint32_t(_primitives.size()), _nodes);
+	_nodes.shrink_to_fit();
+}
+
+size_t bvh::get_overlap(const vec2& point, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_point(point, visitor); },
+		overlap, capacity, [](object_2d& object) { return &object; });
+}
+
+size_t bvh::get_overlap(const vec2& center, float radius, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_circle(center, radius, visitor); },
+		overlap, capacity, [](object_2d& object) { return &object; });
+}
+
+size_t bvh::get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_range(range, visitor); },
+		overlap, capacity, [](object_2d& object) { return &object; });
+}
+
+size_t bvh::memory_usage() const
+{
+	return
+		_nodes.capacity() * sizeof(bvh_node) +
+		_primitives.capacity() * sizeof(primitive);
+}
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "aabb.h"
+#include "growable_stack.h"
+#include "spatial_index.h"
+
+class thread_pool;
+
+/// How the builder picks where to split a set of objects
+enum class bvh_split
+{
+	median,		///< Halves the objects along the longest axis, fastest to build
+	sah			///< Binned surface area heuristic, slower to build but faster to query
+};
+
+/// Options for building a bvh, trading build speed against tree quality
+struct bvh_build_options
+{
+	bvh_split split				= bvh_split::sah;
+	uint32_t max_leaf_size		= 4;
+	uint32_t bin_count			= 16;		///< Bins per axis for the surface area heuristic
+	bool parallel				= true;		///< Build large subtrees on multiple threads
+	thread_pool* pool			= nullptr;	///< Pool for a parallel build, the shared one if null
+	uint32_t parallel_threshold	= 4096;		///< Smallest subtree that gets its own task
+};
+
+/// Trace sink that ignores every node, the default for queries
+struct bvh_null_trace
+{
+	void operator()(const aabb&) const {}
+};
+
+/// Trace sink that collects the boxes of the visited nodes, for debug drawing
+struct bvh_box_trace
+{
+	std::vector<aabb>& boxes;
+	void operator()(const aabb& box) { boxes.push_back(box); }
+};
+
+/// Trace sink that counts the visited nodes
+struct bvh_count_trace
+{
+	size_t& count;
+	void operator()(const aabb&) { count++; }
+};
+
+/// Closest object hit by a ray
+struct bvh_hit
+{
+	object_2d* object	= nullptr;
+	float distance		= 0.0f;		///< Along the ray, in units of the direction's length
+};
+
+/// Object found by a nearest neighbor query
+struct bvh_neighbor
+{
+	object_2d* object	= nullptr;
+	float distance		= 0.0f;		///< From the query point to the circle, zero when inside
+};
+
+/// Bounding volume hierarchy over a set of circles.
+/// The nodes live in one array in depth-first order. The left child of an
+/// interior node is the node right after it and every node stores the index
+/// where its subtree ends, so queries walk the array without a stack.
+class bvh : public spatial_index
+{
+public:
+	/// The objects are referenced, so they need to stay in place while the tree is used
+	bvh(std::vector<object_2d>& bodies, const bvh_build_options& options = bvh_build_options());
+
+	// Queries call visitor(object_2d&) for every object found and stop as soon
+	// as it returns false. The trace sink gets the box of every node that the
+	// query enters. Nothing is allocated unless the tree is unusually deep.
+
+	/// Objects containing the point
+	template <typename V, typename T = bvh_null_trace>
+	void query_point(const glm::vec2& point, V&& visitor, T&& trace = T()) const;
+
+	/// Objects overlapping the circle
+	template <typename V, typename T = bvh_null_trace>
+	void query_circle(const glm::vec2& center, float radius, V&& visitor, T&& trace = T()) const;
+
+	/// Objects overlapping the box
+	template <typename V, typename T = bvh_null_trace>
+	void query_range(const aabb& range, V&& visitor, T&& trace = T()) const;
+
+	/// Closest object along the ray within max_distance, returns false on a miss.
+	/// The direction doesn't need to be normalized but can't be zero.
+	template <typename T = bvh_null_trace>
+	bool raycast(const glm::vec2& origin, const glm::vec2& direction, float max_distance, bvh_hit& hit, T&& trace = T()) const;
+
+	/// Up to k objects closest to the point, sorted by distance. Returns how many were found.
+	template <typename T = bvh_null_trace>
+	size_t nearest(const glm::vec2& point, size_t k, bvh_neighbor* neighbors, T&& trace = T()) const;
+
+	// Write the objects found into the buffer and return how many there are,
+	// which can be more than the capacity. Only the first capacity are written.
+
+	size_t get_overlap(const glm::vec2& point, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const glm::vec2& center, float radius, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const override;
+
+	const char* name() const override { return "bvh"; }
+
+	/// Number of nodes in the tree
+	size_t node_count() const { return _nodes.size(); }
+
+	/// Bytes used by the nodes and the primitives
+	size_t memory_usage() const override;
+
+	struct bvh_node
+	{
+		aabb bounding_box;
+		uint32_t first			= 0;	// First primitive of a leaf
+		uint32_t count			= 0;	// Primitives in a leaf, zero for interior nodes
+		uint32_t right			= 0;	// Right child of an interior node, the left child is next
+		uint32_t skip			= 0;	// Node to continue with when this subtree is skipped
+	};
+	static_assert(sizeof(bvh_node) == 32, "bvh nodes should stay 32 bytes");
+
+	/// Copy of the data needed to test an object, stored in leaf order
+	struct primitive
+	{
+		glm::vec2 position;
+		float radius;
+		uint32_t index;
+	};
+
+	/// Nodes in depth-first order, the root is the first one
+	const std::vector<bvh_node>& nodes() const { return _nodes; }
+
+	/// Primitives in leaf order, a leaf covers [first, first + count)
+	const std::vector<primitive>& primitives() const { return _primitives; }
+
+	/// Objects the primitive indices refer to
+	object_2d* objects() const { return _objects; }
+
+private:
+	struct builder;
+
+	template <typename N, typename P, typename V, typename T>
+	void query(N&& node_test, P&& primitive_test, V&& visitor, T&& trace) const;
+
+	std::vector<bvh_node>	_nodes;
+	std::vector<primitive>	_primitives;
+	object_2d*				_objects	= nullptr;
+};
+
+template <typename N, typename P, typename V, typename T>
+void bvh::query(N&& node_test, P&& primitive_test, V&& visitor, T&& trace) const
+{
+	const auto count = uint32_t(_nodes.size());
+	uint32_t i = 0;
+	while (i < count)
+	{
+		const auto& node = _nodes[i];
+		if (!node_test(node.bounding_box))
+		{
+			i = node.skip;
+			continue;
+		}
+
+		trace(node.bounding_box);
+		for (uint32_t p = node.first; p < node.first + node.count; p++)
+		{
+			const auto& prim = _primitives[p];
+			if (primitive_test(prim) && !visitor(_objects[prim.index]))
+				return;
+		}
+		i++;
+	}
+}
+
+template <typename V, typename T>
+void bvh::query_point(const glm::vec2& point, V&& visitor, T&& trace) const
+{
+	query(
+		[&](const aabb& box) { return box.overlap(point); },
+		[&](const primitive& prim)
+		{
+			const glm::vec2 d = point - prim.position;
+			return glm::dot(d, d) < prim.radius * prim.radius;
+		},
+		visitor, trace);
+}
+
+template <typename V, typename T>
+void bvh::query_circle(const glm::vec2& center, float radius, V&& visitor, T&& trace) const
+{
+	query(
+		[&](const aabb& box) { return box.distance_squared(center) <= radius * radius; },
+		[&](const primitive& prim)
+		{
+			const glm::vec2 d = center - prim.position;
+			const float r = radius + prim.radius;
+			return glm::dot(d, d) < r * r;
+		},
+		visitor, trace);
+}
+
+template <typename V, typename T>
+void bvh::query_range(const aabb& range, V&& visitor, T&& trace) const
+{
+	query(
+		[&](const aabb& box) { return box.overlap(range); },
+		[&](const primitive& prim)
+		{
+			return range.distance_squared(prim.position) < prim.radius * prim.radius;
+		},
+		visitor, trace);
+}
+
+template <typename T>
+bool bvh::raycast(const glm::vec2& origin, const glm::vec2& direction, float max_distance, bvh_hit& hit, T&& trace) const
+{
+	if (_nodes.empty())
+		return false;
+
+	const glm::vec2 inverse = 1.0f / direction;
+	const float a = glm::dot(direction, direction);
+
+	// Whether the ray enters the box before max_distance, and where. A miss
+	// is reported on its own, so no distance doubles as a sentinel.
+	auto enter = [&](const aabb& box, float& t)
+	{
+		float t_enter = 0.0f;
+		float t_exit = max_distance;
+		for (int axis = 0; axis < 2; axis++)
+		{
+			// A ray parallel to an axis is either always between the box's sides
+			// or never. The slab distances would be 0 * inf on an edge.
+			if (std::isinf(inverse[axis]))
+			{
+				if (origin[axis] < box.min[axis] || origin[axis] > box.max[axis])
+					return false;
+				continue;
+			}
+			const float t0 = (box.min[axis] - origin[axis]) * inverse[axis];
+			const float t1 = (box.max[axis] - origin[axis]) * inverse[axis];
+			t_enter = glm::max(t_enter, glm::min(t0, t1));
+			t_exit = glm::min(t_exit, glm::max(t0, t1));
+		}
+		t = t_enter;
+		return t_enter <= t_exit;
+	};
+
+	hit.object = nullptr;
+	growable_stack<uint32_t, 64> stack;
+	float t_root;
+	if (enter(_nodes[0].bounding_box, t_root))
+		stack.push(0);
+
+	while (!stack.empty())
+	{
+		// A closer hit may have been found since the node was pushed
+		const auto& node = _nodes[stack.pop()];
+		float t_node;
+		if (!enter(node.bounding_box, t_node))
+			continue;
+		trace(node.bounding_box);
+
+		if (node.count == 0)
+		{
+			// Push the far child first, so the near one is handled first
+			const auto left = uint32_t(&node - _nodes.data()) + 1;
+			float t_left;
+			float t_right;
+			const bool hit_left = enter(_nodes[left].bounding_box, t_left);
+			const bool hit_right = enter(_nodes[node.right].bounding_box, t_right);
+			if (hit_left && hit_right)
+			{
+				const bool left_first = t_left <= t_right;
+				stack.push(left_first ? node.right : left);
+				stack.push(left_first ? left : node.right);
+			}
+			else if (hit_left)
+			{
+				stack.push(left);
+			}
+			else if (hit_right)
+			{
+				stack.push(node.right);
+			}
+			continue;
+		}
+
+		for (uint32_t p = node.first; p < node.first + node.count; p++)
+		{
+			// Solve |origin + t * direction - position| = radius for the first t
+			const auto& prim = _primitives[p];
+			const glm::vec2 m = origin - prim.position;
+			const float b = glm::dot(m, direction);
+			const float c = glm::dot(m, m) - prim.radius * prim.radius;
+			if (c > 0.0f && b > 0.0f)
+				continue;
+			const float discriminant = b * b - a * c;
+			if (discriminant < 0.0f)
+				continue;
+			const float t = glm::max((-b - std::sqrt(discriminant)) / a, 0.0f);
+			if (t <= max_distance)
+			{
+				max_distance = t;
+				hit.object = _objects + prim.index;
+				hit.distance = t;
+			}
+		}
+	}
+	return hit.object != nullptr;
+}
+
+template <typename T>
+size_t bvh::nearest(const glm::vec2& point, size_t k, bvh_neighbor* neighbors, T&& trace) const
+{
+	if (_nodes.empty() || k == 0)
+		return 0;
+
+	// The buffer is a max heap on distance while searching
+	auto further = [](const bvh_neighbor& n0, const bvh_neighbor& n1) { return n0.distance < n1.distance; };
+	size_t found = 0;
+
+	growable_stack<uint32_t, 64> stack;
+	stack.push(0);
+	while (!stack.empty())
+	{
+		const auto& node = _nodes[stack.pop()];
+		// Boxes contain their circles, so nothing in a box can be closer than the box
+		if (found == k)
+		{
+			const float bound = neighbors[0].distance;
+			if (node.bounding_box.distance_squared(point) >= bound * bound)
+				continue;
+		}
+		trace(node.bounding_box);
+
+		if (node.count == 0)
+		{
+			const auto left = uint32_t(&node - _nodes.data()) + 1;
+			const bool left_first =
+				_nodes[left].bounding_box.distance_squared(point) <=
+				_nodes[node.right].bounding_box.distance_squared(point);
+			stack.push(left_first ? node.right : left);
+			stack.push(left_first ? left : node.right);
+			continue;
+		}
+
+		for (uint32_t p = node.first; p < node.first + node.count; p++)
+		{
+			const auto& prim = _primitives[p];
+			const float distance = glm::max(glm::length(point - prim.position) - prim.radius, 0.0f);
+			if (found < k)
+			{
+				neighbors[found++] = { _objects + prim.index, distance };
+				std::push_heap(neighbors, neighbors + found, further);
+			}
+			else if (distance < neighbors[0].distance)
+			{
+				std::pop_heap(neighbors, neighbors + found, further);
+				neighbors[found - 1] = { _objects + prim.index, distance };
+				std::push_heap(neighbors, neighbors + found, further);
+			}
+		}
+	}
+
+	std::sort_heap(neighbors, neighbors + found, further);
+	return found;
+}
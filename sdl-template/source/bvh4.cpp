@@ -0,0 +1,487 @@
+#include "bvh4.h"
+#include <algorithm>
+#include <cfloat>
+#include "bvh_collapse.h"
+#include "growable_stack.h"
+
+using namespace glm;
+
+namespace
+{
+	// Every kernel returns a bit mask with one bit per lane that passed the test.
+	// Circle kernels read eight lanes, the primitive arrays are padded for it.
+
+	struct scalar_kernel
+	{
+		/// One point against the four child boxes of a node
+		static uint32_t point_in_boxes(
+			const float* min_x, const float* min_y,
+			const float* max_x, const float* max_y,
+			float px, float py)
+		{
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				if (min_x[i] <= px && min_y[i] <= py && max_x[i] >= px && max_y[i] >= py)
+					mask |= 1u << i;
+			}
+			return mask;
+		}
+
+		/// One point against up to eight circles
+		static uint32_t point_in_circles(
+			const float* x, const float* y, const float* r,
+			uint32_t lanes, float px, float py)
+		{
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < lanes; i++)
+			{
+				const float dx = px - x[i];
+				const float dy = py - y[i];
+				if (dx * dx + dy * dy < r[i] * r[i])
+					mask |= 1u << i;
+			}
+			return mask;
+		}
+
+		/// Eight points against one box
+		static uint32_t points_in_box(
+			const float* px, const float* py,
+			float min_x, float min_y, float max_x, float max_y)
+		{
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				if (min_x <= px[i] && min_y <= py[i] && max_x >= px[i] && max_y >= py[i])
+					mask |= 1u << i;
+			}
+			return mask;
+		}
+
+		/// Eight points against one circle
+		static uint32_t points_in_circle(
+			const float* px, const float* py,
+			float x, float y, float r)
+		{
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				const float dx = px[i] - x;
+				const float dy = py[i] - y;
+				if (dx * dx + dy * dy < r * r)
+					mask |= 1u << i;
+			}
+			return mask;
+		}
+	};
+
+#if SIMD_X64
+	struct sse2_kernel
+	{
+		static SIMD_INLINE uint32_t point_in_boxes(
+			const float* min_x, const float* min_y,
+			const float* max_x, const float* max_y,
+			float px, float py)
+		{
+			const __m128 x = _mm_set1_ps(px);
+			const __m128 y = _mm_set1_ps(py);
+			const __m128 in_min = _mm_and_ps(
+				_mm_cmple_ps(_mm_loadu_ps(min_x), x),
+				_mm_cmple_ps(_mm_loadu_ps(min_y), y));
+			const __m128 in_max = _mm_and_ps(
+				_mm_cmpge_ps(_mm_loadu_ps(max_x), x),
+				_mm_cmpge_ps(_mm_loadu_ps(max_y), y));
+			return uint32_t(_mm_movemask_ps(_mm_and_ps(in_min, in_max)));
+		}
+
+		static SIMD_INLINE uint32_t circles4(
+			const float* x, const float* y, const float* r,
+			__m128 px, __m128 py)
+		{
+			const __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(x));
+			const __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(y));
+			const __m128 rr = _mm_loadu_ps(r);
+			const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			return uint32_t(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(rr, rr))));
+		}
+
+		static SIMD_INLINE uint32_t point_in_circles(
+			const float* x, const float* y, const float* r,
+			uint32_t lanes, float px, float py)
+		{
+			const __m128 vx = _mm_set1_ps(px);
+			const __m128 vy = _mm_set1_ps(py);
+			uint32_t mask = circles4(x, y, r, vx, vy);
+			if (lanes > 4)
+				mask |= circles4(x + 4, y + 4, r + 4, vx, vy) << 4;
+			return mask;
+		}
+
+		static SIMD_INLINE uint32_t box4(
+			const float* px, const float* py,
+			__m128 min_x, __m128 min_y, __m128 max_x, __m128 max_y)
+		{
+			const __m128 x = _mm_loadu_ps(px);
+			const __m128 y = _mm_loadu_ps(py);
+			const __m128 in_min = _mm_and_ps(_mm_cmple_ps(min_x, x), _mm_cmple_ps(min_y, y));
+			const __m128 in_max = _mm_and_ps(_mm_cmpge_ps(max_x, x), _mm_cmpge_ps(max_y, y));
+			return uint32_t(_mm_movemask_ps(_mm_and_ps(in_min, in_max)));
+		}
+
+		static SIMD_INLINE uint32_t points_in_box(
+			const float* px, const float* py,
+			float min_x, float min_y, float max_x, float max_y)
+		{
+			const __m128 x0 = _mm_set1_ps(min_x);
+			const __m128 y0 = _mm_set1_ps(min_y);
+			const __m128 x1 = _mm_set1_ps(max_x);
+			const __m128 y1 = _mm_set1_ps(max_y);
+			return box4(px, py, x0, y0, x1, y1) | (box4(px + 4, py + 4, x0, y0, x1, y1) << 4);
+		}
+
+		static SIMD_INLINE uint32_t circle4(
+			const float* px, const float* py,
+			__m128 x, __m128 y, __m128 rr)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(px), x);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(py), y);
+			const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			return uint32_t(_mm_movemask_ps(_mm_cmplt_ps(d2, rr)));
+		}
+
+		static SIMD_INLINE uint32_t points_in_circle(
+			const float* px, const float* py,
+			float x, float y, float r)
+		{
+			const __m128 vx = _mm_set1_ps(x);
+			const __m128 vy = _mm_set1_ps(y);
+			const __m128 rr = _mm_set1_ps(r * r);
+			return circle4(px, py, vx, vy, rr) | (circle4(px + 4, py + 4, vx, vy, rr) << 4);
+		}
+	};
+
+	/// Nodes have four children, so the box test stays SSE
+	struct avx2_kernel : sse2_kernel
+	{
+		SIMD_TARGET_AVX2 static uint32_t point_in_circles(
+			const float* x, const float* y, const float* r,
+			uint32_t, float px, float py)
+		{
+			const __m256 dx = _mm256_sub_ps(_mm256_set1_ps(px), _mm256_loadu_ps(x));
+			const __m256 dy = _mm256_sub_ps(_mm256_set1_ps(py), _mm256_loadu_ps(y));
+			const __m256 rr = _mm256_loadu_ps(r);
+			const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(rr, rr), _CMP_LT_OQ)));
+		}
+
+		SIMD_TARGET_AVX2 static uint32_t points_in_box(
+			const float* px, const float* py,
+			float min_x, float min_y, float max_x, float max_y)
+		{
+			const __m256 x = _mm256_loadu_ps(px);
+			const __m256 y = _mm256_loadu_ps(py);
+			const __m256 in_min = _mm256_and_ps(
+				_mm256_cmp_ps(_mm256_set1_ps(min_x), x, _CMP_LE_OQ),
+				_mm256_cmp_ps(_mm256_set1_ps(min_y), y, _CMP_LE_OQ));
+			const __m256 in_max = _mm256_and_ps(
+				_mm256_cmp_ps(_mm256_set1_ps(max_x), x, _CMP_GE_OQ),
+				_mm256_cmp_ps(_mm256_set1_ps(max_y), y, _CMP_GE_OQ));
+			return uint32_t(_mm256_movemask_ps(_mm256_and_ps(in_min, in_max)));
+		}
+
+		SIMD_TARGET_AVX2 static uint32_t points_in_circle(
+			const float* px, const float* py,
+			float x, float y, float r)
+		{
+			const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(px), _mm256_set1_ps(x));
+			const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(py), _mm256_set1_ps(y));
+			const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_set1_ps(r * r), _CMP_LT_OQ)));
+		}
+	};
+#endif
+}
+
+/// The traversals are written once against a kernel and inlined into one
+/// entry point per level, so the AVX2 entry point is compiled for AVX2
+/// without the rest of the program needing it.
+struct bvh4::traversal
+{
+	struct packet_entry
+	{
+		uint32_t node;
+		uint32_t mask;
+	};
+
+	template <typename K>
+	static SIMD_INLINE void point(const bvh4& tree, float px, float py, std::vector<object_2d*>& overlap)
+	{
+		growable_stack<uint32_t, 64> stack;
+		stack.push(0);
+		while (!stack.empty())
+		{
+			const auto& n = tree._nodes[stack.pop()];
+			uint32_t mask = K::point_in_boxes(n.min_x, n.min_y, n.max_x, n.max_y, px, py);
+			while (mask)
+			{
+				const auto i = lowest_bit(mask);
+				mask &= mask - 1;
+
+				if (n.count[i] == 0)
+				{
+					stack.push(n.child[i]);
+					continue;
+				}
+
+				const auto end = n.child[i] + n.count[i];
+				for (auto p = n.child[i]; p < end; p += 8)
+				{
+					const auto lanes = std::min(end - p, 8u);
+					uint32_t hits = K::point_in_circles(
+						&tree._x[p], &tree._y[p], &tree._radius[p], lanes, px, py);
+					hits &= (1u << lanes) - 1;
+					while (hits)
+					{
+						overlap.push_back(tree._objects + tree._index[p + lowest_bit(hits)]);
+						hits &= hits - 1;
+					}
+				}
+			}
+		}
+	}
+
+	template <typename K>
+	static SIMD_INLINE void packet(const bvh4& tree, const float* px, const float* py, uint32_t active, std::vector<object_2d*>* overlaps)
+	{
+		growable_stack<packet_entry, 64> stack;
+		stack.push({ 0, active });
+		while (!stack.empty())
+		{
+			const auto entry = stack.pop();
+			const auto& n = tree._nodes[entry.node];
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				const uint32_t mask = entry.mask & K::points_in_box(
+					px, py, n.min_x[i], n.min_y[i], n.max_x[i], n.max_y[i]);
+				if (!mask)
+					continue;
+
+				if (n.count[i] == 0)
+				{
+					stack.push({ n.child[i], mask });
+					continue;
+				}
+
+				const auto end = n.child[i] + n.count[i];
+				for (auto p = n.child[i]; p < end; p++)
+				{
+					uint32_t hits = mask & K::points_in_circle(
+						px, py, tree._x[p], tree._y[p], tree._radius[p]);
+					while (hits)
+					{
+						overlaps[lowest_bit(hits)].push_back(tree._objects + tree._index[p]);
+						hits &= hits - 1;
+					}
+				}
+			}
+		}
+	}
+
+	static void point_scalar(const bvh4& tree, float px, float py, std::vector<object_2d*>& overlap)
+	{
+		point<scalar_kernel>(tree, px, py, overlap);
+	}
+
+	static void packet_scalar(const bvh4& tree, const float* px, const float* py, uint32_t active, std::vector<object_2d*>* overlaps)
+	{
+		packet<scalar_kernel>(tree, px, py, active, overlaps);
+	}
+
+#if SIMD_X64
+	static void point_sse2(const bvh4& tree, float px, float py, std::vector<object_2d*>& overlap)
+	{
+		point<sse2_kernel>(tree, px, py, overlap);
+	}
+
+	static void packet_sse2(const bvh4& tree, const float* px, const float* py, uint32_t active, std::vector<object_2d*>* overlaps)
+	{
+		packet<sse2_kernel>(tree, px, py, active, overlaps);
+	}
+
+	SIMD_TARGET_AVX2 static void point_avx2(const bvh4& tree, float px, float py, std::vector<object_2d*>& overlap)
+	{
+		point<avx2_kernel>(tree, px, py, overlap);
+	}
+
+	SIMD_TARGET_AVX2 static void packet_avx2(const bvh4& tree, const float* px, const float* py, uint32_t active, std::vector<object_2d*>* overlaps)
+	{
+		packet<avx2_kernel>(tree, px, py, active, overlaps);
+	}
+#endif
+};
+
+bvh4::bvh4(const bvh& tree, simd_level level) :
+	_objects(tree.objects()),
+	_level(std::min(level, detect_simd_level()))
+{
+	const auto& primitives = tree.primitives();
+	const auto& nodes = tree.nodes();
+
+	// Leaf order is kept, padded so the kernels can always read eight lanes
+	const size_t padded = primitives.size() + 8;
+	_x.resize(padded, 0.0f);
+	_y.resize(padded, 0.0f);
+	_radius.resize(padded, 0.0f);
+	_index.resize(padded, 0);
+	for (size_t i = 0; i < primitives.size(); i++)
+	{
+		_x[i] = primitives[i].position.x;
+		_y[i] = primitives[i].position.y;
+		_radius[i] = primitives[i].radius;
+		_index[i] = primitives[i].index;
+	}
+
+	if (nodes.empty())
+		return;
+
+	const bvh_collapse collapse(tree, max_leaf_size);
+	_nodes.reserve(nodes.size() / 2 + 1);
+	build(collapse, 0);
+	_nodes.shrink_to_fit();
+}
+
+void bvh4::get_overlap(vec2 pos, std::vector<object_2d*>& overlap) const
+{
+	if (_nodes.empty())
+		return;
+
+	switch (_level)
+	{
+#if SIMD_X64
+	case simd_level::avx2:
+		traversal::point_avx2(*this, pos.x, pos.y, overlap);
+		break;
+	case simd_level::sse2:
+		traversal::point_sse2(*this, pos.x, pos.y, overlap);
+		break;
+#endif
+	default:
+		traversal::point_scalar(*this, pos.x, pos.y, overlap);
+		break;
+	}
+}
+
+void bvh4::get_overlap(const vec2* points, size_t count, std::vector<object_2d*>* overlaps) const
+{
+	if (_nodes.empty())
+		return;
+
+	for (size_t from = 0; from < count; from += 8)
+	{
+		const auto lanes = uint32_t(std::min(count - from, size_t(8)));
+		float px[8] = {};
+		float py[8] = {};
+		for (uint32_t i = 0; i < lanes; i++)
+		{
+			px[i] = points[from + i].x;
+			py[i] = points[from + i].y;
+		}
+		const uint32_t active = (1u << lanes) - 1;
+
+		switch (_level)
+		{
+#if SIMD_X64
+		case simd_level::avx2:
+			traversal::packet_avx2(*this, px, py, active, overlaps + from);
+			break;
+		case simd_level::sse2:
+			traversal::packet_sse2(*this, px, py, active, overlaps + from);
+			break;
+#endif
+		default:
+			traversal::packet_scalar(*this, px, py, active, overlaps + from);
+			break;
+		}
+	}
+}
+
+size_t bvh4::nodes_visited(vec2 pos) const
+{
+	if (_nodes.empty())
+		return 0;
+
+	// The root box is the union of its children, as in the binary tree
+	const auto& root = _nodes[0];
+	aabb bounds;
+	for (uint32_t i = 0; i < 4; i++)
+		bounds.add(aabb(vec2(root.min_x[i], root.min_y[i]), vec2(root.max_x[i], root.max_y[i])));
+	if (!bounds.overlap(pos))
+		return 0;
+
+	size_t visited = 1;
+	growable_stack<uint32_t, 64> stack;
+	stack.push(0);
+	while (!stack.empty())
+	{
+		const auto& n = _nodes[stack.pop()];
+		uint32_t mask = scalar_kernel::point_in_boxes(n.min_x, n.min_y, n.max_x, n.max_y, pos.x, pos.y);
+		while (mask)
+		{
+			const auto i = lowest_bit(mask);
+			mask &= mask - 1;
+
+			visited++;
+			if (n.count[i] == 0)
+				stack.push(n.child[i]);
+		}
+	}
+	return visited;
+}
+
+size_t bvh4::memory_usage() const
+{
+	return
+		_nodes.capacity() * sizeof(node) +
+		(_x.capacity() + _y.capacity() + _radius.capacity()) * sizeof(float) +
+		_index.capacity() * sizeof(uint32_t);
+}
+
+uint32_t bvh4::build(const bvh_collapse& collapse, uint32_t index)
+{
+	uint32_t children[4];
+	const uint32_t child_count = collapse.children(index, children);
+
+	const auto result = uint32_t(_nodes.size());
+	_nodes.emplace_back();
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		// Empty slots get an inverted box that nothing is ever inside
+		aabb box;
+		uint32_t child = 0;
+		uint32_t primitives = 0;
+		if (i < child_count)
+		{
+			const auto c = children[i];
+			box = collapse.box(c);
+			if (collapse.leaf(c))
+			{
+				child = collapse.first(c);
+				primitives = collapse.count(c);
+			}
+			else
+			{
+				child = build(collapse, c);
+			}
+		}
+
+		// Building children may have moved the nodes
+		auto& n = _nodes[result];
+		n.min_x[i] = box.min.x;
+		n.min_y[i] = box.min.y;
+		n.max_x[i] = box.max.x;
+		n.max_y[i] = box.max.y;
+		n.child[i] = child;
+		n.count[i] = primitives;
+	}
+	return result;
+}
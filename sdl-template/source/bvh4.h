@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "simd.h"
+
+class bvh_collapse;
+
+/// Four-wide bounding volume hierarchy, collapsed from a binary bvh.
+/// Each node keeps the boxes of its four children side by side, so one point
+/// is tested against all of them with a single SSE compare. Leaves hold up to
+/// eight circles in separate x, y and radius arrays that AVX2 tests at once.
+/// The kernels are picked at runtime from what the cpu supports.
+class bvh4
+{
+public:
+	/// Queries use the given level, or the best one the cpu supports if that is lower
+	explicit bvh4(const bvh& tree, simd_level level = detect_simd_level());
+
+	/// Collects the objects containing the point
+	void get_overlap(glm::vec2 pos, std::vector<object_2d*>& overlap) const;
+
+	/// Collects the objects containing each of the points in one traversal per
+	/// eight points. The results for points[i] go to overlaps[i].
+	void get_overlap(const glm::vec2* points, size_t count, std::vector<object_2d*>* overlaps) const;
+
+	/// Nodes whose box contains the point, counted the way bvh_count_trace counts
+	/// them for the bvh. Walks the tree on its own, so queries don't pay for it.
+	size_t nodes_visited(glm::vec2 pos) const;
+
+	simd_level level() const { return _level; }
+
+	/// Number of nodes in the tree
+	size_t node_count() const { return _nodes.size(); }
+
+	/// Bytes used by the nodes and the primitives
+	size_t memory_usage() const;
+
+	/// Leaves of the binary tree with this many objects or fewer are merged
+	enum { max_leaf_size = 8 };
+
+private:
+	struct alignas(16) node
+	{
+		float min_x[4];
+		float min_y[4];
+		float max_x[4];
+		float max_y[4];
+		uint32_t child[4];		// Child node, or first primitive for a leaf
+		uint32_t count[4];		// Primitives in a leaf, zero for child nodes and empty slots
+	};
+
+	struct traversal;
+
+	uint32_t build(const bvh_collapse& collapse, uint32_t index);
+
+	std::vector<node>		_nodes;
+	std::vector<float>		_x;
+	std::vector<float>		_y;
+	std::vector<float>		_radius;
+	std::vector<uint32_t>	_index;
+	object_2d*				_objects	= nullptr;
+	simd_level				_level;
+};
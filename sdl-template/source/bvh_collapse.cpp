@@ -0,0 +1,67 @@
+#include "bvh_collapse.h"
+
+bvh_collapse::bvh_collapse(const bvh& tree, uint32_t max_leaf_size) :
+	_nodes(tree.nodes()),
+	_first(tree.nodes().size()),
+	_count(tree.nodes().size()),
+	_max_leaf_size(max_leaf_size)
+{
+	// Subtrees in the binary tree cover a contiguous range of primitives.
+	// Children come after their parent, so walking backwards sees them first.
+	for (size_t i = _nodes.size(); i-- > 0;)
+	{
+		const auto& n = _nodes[i];
+		if (n.count)
+		{
+			_first[i] = n.first;
+			_count[i] = n.count;
+		}
+		else
+		{
+			_first[i] = _first[i + 1];
+			_count[i] = _count[i + 1] + _count[n.right];
+		}
+	}
+}
+
+uint32_t bvh_collapse::children(uint32_t index, uint32_t* children) const
+{
+	// Open up the binary tree until there are four children, always splitting
+	// the largest child that is too big to become a leaf. Its children take
+	// its place, which keeps them in depth-first order.
+	uint32_t child_count = 0;
+	if (leaf(index))
+	{
+		children[child_count++] = index;
+	}
+	else
+	{
+		children[child_count++] = index + 1;
+		children[child_count++] = _nodes[index].right;
+	}
+
+	while (child_count < 4)
+	{
+		int largest = -1;
+		float largest_perimeter = -1.0f;
+		for (uint32_t i = 0; i < child_count; i++)
+		{
+			const float perimeter = _nodes[children[i]].bounding_box.perimeter();
+			if (!leaf(children[i]) && perimeter > largest_perimeter)
+			{
+				largest = int(i);
+				largest_perimeter = perimeter;
+			}
+		}
+		if (largest < 0)
+			break;
+
+		const auto opened = children[largest];
+		for (uint32_t i = child_count; i > uint32_t(largest) + 1; i--)
+			children[i] = children[i - 1];
+		children[largest] = opened + 1;
+		children[largest + 1] = _nodes[opened].right;
+		child_count++;
+	}
+	return child_count;
+}
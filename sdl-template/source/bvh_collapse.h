@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+
+/// Collapses a binary bvh into a tree with four children per node. Knows the
+/// range of primitives under every binary node and picks the binary nodes
+/// that become the children of a wide node. The wide trees only lay out and
+/// encode what it picks.
+class bvh_collapse
+{
+public:
+	/// Subtrees with max_leaf_size primitives or fewer become one leaf. The tree has to outlive this.
+	bvh_collapse(const bvh& tree, uint32_t max_leaf_size);
+
+	/// Whether the subtree at a binary node becomes a single leaf of the wide tree
+	bool leaf(uint32_t index) const { return _nodes[index].count != 0 || _count[index] <= _max_leaf_size; }
+
+	/// First primitive of the subtree at a binary node, its primitives are contiguous
+	uint32_t first(uint32_t index) const { return _first[index]; }
+
+	/// Number of primitives in the subtree at a binary node
+	uint32_t count(uint32_t index) const { return _count[index]; }
+
+	const aabb& box(uint32_t index) const { return _nodes[index].bounding_box; }
+
+	/// Binary nodes that become the children of the wide node built for the
+	/// subtree at index, in depth-first order. Returns how many, up to four.
+	uint32_t children(uint32_t index, uint32_t* children) const;
+
+private:
+	const std::vector<bvh::bvh_node>&	_nodes;
+	std::vector<uint32_t>				_first;
+	std::vector<uint32_t>				_count;
+	uint32_t							_max_leaf_size;
+};
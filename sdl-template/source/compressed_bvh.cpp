@@ -0,0 +1,172 @@
+#include "compressed_bvh.h"
+#include <algorithm>
+#include <cmath>
+#include "bvh_collapse.h"
+
+using namespace glm;
+
+namespace
+{
+	const uint32_t max_quantized = 65535;
+}
+
+compressed_bvh::compressed_bvh(const bvh& tree) :
+	_primitives(tree.primitives()),
+	_objects(tree.objects())
+{
+	const auto& nodes = tree.nodes();
+	if (nodes.empty())
+		return;
+	_bounds = nodes[0].bounding_box;
+
+	const bvh_collapse collapse(tree, max_leaf_size);
+	_nodes.reserve(nodes.size() / 2 + 1);
+	build(collapse, 0);
+	_nodes.shrink_to_fit();
+}
+
+compressed_bvh::compressed_bvh(std::vector<object_2d>& objects) :
+	compressed_bvh(bvh(objects))
+{
+}
+
+size_t compressed_bvh::get_overlap(const vec2& point, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_point(point, visitor); },
+		overlap, capacity, [](object_2d& object) { return &object; });
+}
+
+size_t compressed_bvh::get_overlap(const vec2& center, float radius, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_circle(center, radius, visitor); },
+		overlap, capacity, [](object_2d& object) { return &object; });
+}
+
+size_t compressed_bvh::get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_range(range, visitor); },
+		overlap, capacity, [](object_2d& object) { return &object; });
+}
+
+size_t compressed_bvh::memory_usage() const
+{
+	return
+		_nodes.capacity() * sizeof(node) +
+		_primitives.capacity() * sizeof(bvh::primitive);
+}
+
+uint32_t compressed_bvh::build(const bvh_collapse& collapse, uint32_t index)
+{
+	uint32_t children[4];
+	const uint32_t child_count = collapse.children(index, children);
+
+	const auto result = uint32_t(_nodes.size());
+	_nodes.emplace_back();
+
+	slot slots[4];
+	for (uint32_t i = 0; i < child_count; i++)
+	{
+		const auto c = children[i];
+		slots[i].box = collapse.box(c);
+		if (!collapse.leaf(c))
+			slots[i].child = build(collapse, c);
+		else if (collapse.count(c) > max_leaf_count)
+			slots[i].child = build_leaf(collapse.first(c), collapse.count(c));
+		else
+		{
+			slots[i].child = collapse.first(c);
+			slots[i].count = collapse.count(c);
+		}
+	}
+
+	encode(result, collapse.box(index), slots, child_count);
+	return result;
+}
+
+uint32_t compressed_bvh::build_leaf(uint32_t first, uint32_t count)
+{
+	// Leaves of the binary tree can be larger than a slot can count. They get
+	// a node of their own, with the primitives split over the slots in order.
+	const auto result = uint32_t(_nodes.size());
+	_nodes.emplace_back();
+
+	aabb box;
+	slot slots[4];
+	const uint32_t chunk = (count + 3) / 4;
+	uint32_t slot_count = 0;
+	for (uint32_t from = first; from < first + count; from += chunk)
+	{
+		auto& s = slots[slot_count++];
+		const uint32_t size = std::min(chunk, first + count - from);
+		for (uint32_t p = from; p < from + size; p++)
+			s.box.add(_primitives[p].position, _primitives[p].radius);
+		box.add(s.box);
+
+		if (size > max_leaf_count)
+			s.child = build_leaf(from, size);
+		else
+		{
+			s.child = from;
+			s.count = size;
+		}
+	}
+
+	encode(result, box, slots, slot_count);
+	return result;
+}
+
+void compressed_bvh::encode(uint32_t index, const aabb& box, const slot* slots, uint32_t slot_count)
+{
+	// The step on each axis is the smallest power of two that spans the node
+	// in max_quantized steps, checked with the same arithmetic as child_box
+	int exponent[2];
+	for (int axis = 0; axis < 2; axis++)
+	{
+		int e;
+		std::frexp((box.max[axis] - box.min[axis]) / float(max_quantized), &e);
+		e = std::max(e - 1, -126);
+		while (e < 127 && box.min[axis] + float(max_quantized) * step(e) < box.max[axis])
+			e++;
+		exponent[axis] = e;
+	}
+
+	// Round each bound outwards, then nudge it until the box built from it
+	// really contains the original
+	auto quantize_min = [&](float value, int axis)
+	{
+		const float s = step(exponent[axis]);
+		const float q = std::floor((value - box.min[axis]) / s);
+		auto result = uint32_t(std::min(std::max(q, 0.0f), float(max_quantized)));
+		while (result > 0 && box.min[axis] + float(result) * s > value)
+			result--;
+		return uint16_t(result);
+	};
+	auto quantize_max = [&](float value, int axis)
+	{
+		const float s = step(exponent[axis]);
+		const float q = std::ceil((value - box.min[axis]) / s);
+		auto result = uint32_t(std::min(std::max(q, 0.0f), float(max_quantized)));
+		while (result < max_quantized && box.min[axis] + float(result) * s < value)
+			result++;
+		return uint16_t(result);
+	};
+
+	auto& n = _nodes[index];
+	n.origin = box.min;
+	n.exponent[0] = int8_t(exponent[0]);
+	n.exponent[1] = int8_t(exponent[1]);
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		// Empty slots get a box at the origin, they are skipped by their zero child and count
+		const aabb child_bounds = i < slot_count ? slots[i].box : aabb(box.min, box.min);
+		n.min_x[i] = quantize_min(child_bounds.min.x, 0);
+		n.min_y[i] = quantize_min(child_bounds.min.y, 1);
+		n.max_x[i] = quantize_max(child_bounds.max.x, 0);
+		n.max_y[i] = quantize_max(child_bounds.max.y, 1);
+		n.child[i] = i < slot_count ? slots[i].child : 0;
+		n.count[i] = i < slot_count ? uint8_t(slots[i].count) : 0;
+	}
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "simd.h"
+
+class bvh_collapse;
+
+/// Four-wide bounding volume hierarchy with quantized child boxes, collapsed
+/// from a binary bvh. Each node stores its own corner in full precision and
+/// the boxes of its children as 16 bit offsets in power of two steps, which
+/// fits a node in one 64 byte cache line. Boxes are rounded outwards, so a
+/// query can visit a few more nodes but never misses one. Leaves keep the
+/// full precision primitives and are visited in the same order as the bvh,
+/// so the results are exactly the same.
+class compressed_bvh : public spatial_index
+{
+public:
+	/// The primitives are copied, the tree isn't needed after this
+	explicit compressed_bvh(const bvh& tree);
+
+	/// Builds a bvh over the objects first, they need to stay in place while the tree is used
+	explicit compressed_bvh(std::vector<object_2d>& objects);
+
+	// Queries call visitor(object_2d&) for every object found and stop as soon
+	// as it returns false, the same as the bvh queries. The trace sink gets the
+	// root box and every child box that passes the test, quantized boxes as
+	// they were tested.
+
+	/// Objects containing the point
+	template <typename V, typename T = bvh_null_trace>
+	void query_point(const glm::vec2& point, V&& visitor, T&& trace = T()) const;
+
+	/// Objects overlapping the circle
+	template <typename V, typename T = bvh_null_trace>
+	void query_circle(const glm::vec2& center, float radius, V&& visitor, T&& trace = T()) const;
+
+	/// Objects overlapping the box
+	template <typename V, typename T = bvh_null_trace>
+	void query_range(const aabb& range, V&& visitor, T&& trace = T()) const;
+
+	size_t get_overlap(const glm::vec2& point, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const glm::vec2& center, float radius, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const override;
+
+	const char* name() const override { return "compressed_bvh"; }
+
+	/// Number of nodes in the tree
+	size_t node_count() const { return _nodes.size(); }
+
+	/// Bytes used by the nodes and the primitives
+	size_t memory_usage() const override;
+
+	enum
+	{
+		max_leaf_size = 8,		///< Subtrees of the binary tree with this many objects or fewer become one leaf
+		max_leaf_count = 255	///< Most primitives a slot can count, larger binary leaves are split
+	};
+
+	struct alignas(64) node
+	{
+		glm::vec2 origin;			// Lower corner of the node, where quantized offsets start
+		int8_t exponent[2];			// Quantization step is 2^exponent on each axis
+		uint8_t count[4];			// Primitives in a leaf, up to max_leaf_count, zero for child nodes and empty slots
+		uint16_t min_x[4];
+		uint16_t min_y[4];
+		uint16_t max_x[4];
+		uint16_t max_y[4];
+		uint32_t child[4];			// Child node or first primitive of a leaf, empty slots have zero in both
+	};
+	static_assert(sizeof(node) == 64, "compressed bvh nodes should fill one cache line");
+
+	/// Box of a child, never smaller than the one it was built from
+	static aabb child_box(const node& n, uint32_t i);
+
+private:
+	/// Two to the power of the exponent, built from the bits so it is exact and cheap
+	static float step(int exponent);
+
+	/// Child boxes of a node as four wide arrays, with the same arithmetic as child_box
+	struct child_boxes
+	{
+		float min_x[4];
+		float min_y[4];
+		float max_x[4];
+		float max_y[4];
+	};
+	static void decode(const node& n, child_boxes& boxes);
+
+	/// A child node waiting to be entered, or a leaf waiting to be tested
+	struct entry
+	{
+		uint32_t child;
+		uint32_t count;
+	};
+
+	/// A child of a node before it is quantized
+	struct slot
+	{
+		aabb box;
+		uint32_t child	= 0;
+		uint32_t count	= 0;
+	};
+
+	uint32_t build(const bvh_collapse& collapse, uint32_t index);
+	uint32_t build_leaf(uint32_t first, uint32_t count);
+	void encode(uint32_t index, const aabb& box, const slot* slots, uint32_t slot_count);
+
+	template <typename N, typename P, typename V, typename T>
+	void query(N&& node_test, P&& primitive_test, V&& visitor, T&& trace) const;
+
+	std::vector<node, aligned_allocator<node, 64>>	_nodes;
+	aabb											_bounds;
+	std::vector<bvh::primitive>						_primitives;
+	object_2d*										_objects	= nullptr;
+};
+
+inline float compressed_bvh::step(int exponent)
+{
+	const uint32_t bits = uint32_t(exponent + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return scale;
+}
+
+inline aabb compressed_bvh::child_box(const node& n, uint32_t i)
+{
+	const float sx = step(n.exponent[0]);
+	const float sy = step(n.exponent[1]);
+	return aabb(
+		glm::vec2(n.origin.x + float(n.min_x[i]) * sx, n.origin.y + float(n.min_y[i]) * sy),
+		glm::vec2(n.origin.x + float(n.max_x[i]) * sx, n.origin.y + float(n.max_y[i]) * sy));
+}
+
+inline void compressed_bvh::decode(const node& n, child_boxes& boxes)
+{
+#if SIMD_X64
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 ox = _mm_set1_ps(n.origin.x);
+	const __m128 oy = _mm_set1_ps(n.origin.y);
+	const __m128 sx = _mm_set1_ps(step(n.exponent[0]));
+	const __m128 sy = _mm_set1_ps(step(n.exponent[1]));
+	auto lanes = [&](const uint16_t* q)
+	{
+		const __m128i wide = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q)), zero);
+		return _mm_cvtepi32_ps(wide);
+	};
+	_mm_storeu_ps(boxes.min_x, _mm_add_ps(ox, _mm_mul_ps(lanes(n.min_x), sx)));
+	_mm_storeu_ps(boxes.min_y, _mm_add_ps(oy, _mm_mul_ps(lanes(n.min_y), sy)));
+	_mm_storeu_ps(boxes.max_x, _mm_add_ps(ox, _mm_mul_ps(lanes(n.max_x), sx)));
+	_mm_storeu_ps(boxes.max_y, _mm_add_ps(oy, _mm_mul_ps(lanes(n.max_y), sy)));
+#else
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		const aabb box = child_box(n, i);
+		boxes.min_x[i] = box.min.x;
+		boxes.min_y[i] = box.min.y;
+		boxes.max_x[i] = box.max.x;
+		boxes.max_y[i] = box.max.y;
+	}
+#endif
+}
+
+template <typename N, typename P, typename V, typename T>
+void compressed_bvh::query(N&& node_test, P&& primitive_test, V&& visitor, T&& trace) const
+{
+	if (_nodes.empty() || !node_test(_bounds))
+		return;
+	trace(_bounds);
+
+	// Leaves go on the stack with the nodes, so they are tested in the same
+	// depth-first order as the binary tree
+	growable_stack<entry, 64> stack;
+	stack.push({ 0, 0 });
+	while (!stack.empty())
+	{
+		const auto e = stack.pop();
+		if (e.count)
+		{
+			for (uint32_t p = e.child; p < e.child + e.count; p++)
+			{
+				const auto& prim = _primitives[p];
+				if (primitive_test(prim) && !visitor(_objects[prim.index]))
+					return;
+			}
+			continue;
+		}
+
+		const auto& n = _nodes[e.child];
+		child_boxes boxes;
+		decode(n, boxes);
+		for (uint32_t i = 4; i-- > 0;)
+		{
+			const aabb box(glm::vec2(boxes.min_x[i], boxes.min_y[i]), glm::vec2(boxes.max_x[i], boxes.max_y[i]));
+			if ((n.child[i] | n.count[i]) != 0 && node_test(box))
+			{
+				trace(box);
+				stack.push({ n.child[i], n.count[i] });
+			}
+		}
+	}
+}
+
+template <typename V, typename T>
+void compressed_bvh::query_point(const glm::vec2& point, V&& visitor, T&& trace) const
+{
+	query(
+		[&](const aabb& box) { return box.overlap(point); },
+		[&](const bvh::primitive& prim)
+		{
+			const glm::vec2 d = point - prim.position;
+			return glm::dot(d, d) < prim.radius * prim.radius;
+		},
+		visitor, trace);
+}
+
+template <typename V, typename T>
+void compressed_bvh::query_circle(const glm::vec2& center, float radius, V&& visitor, T&& trace) const
+{
+	query(
+		[&](const aabb& box) { return box.distance_squared(center) <= radius * radius; },
+		[&](const bvh::primitive& prim)
+		{
+			const glm::vec2 d = center - prim.position;
+			const float r = radius + prim.radius;
+			return glm::dot(d, d) < r * r;
+		},
+		visitor, trace);
+}
+
+template <typename V, typename T>
+void compressed_bvh::query_range(const aabb& range, V&& visitor, T&& trace) const
+{
+	query(
+		[&](const aabb& box) { return box.overlap(range); },
+		[&](const bvh::primitive& prim)
+		{
+			return range.distance_squared(prim.position) < prim.radius * prim.radius;
+		},
+		visitor, trace);
+}
@@ -0,0 +1,261 @@
+#include "dynamic_bvh.h"
+#include <algorithm>
+
+using namespace glm;
+
+namespace
+{
+	aabb combine(const aabb& a, const aabb& b)
+	{
+		aabb box = a;
+		box.add(b);
+		return box;
+	}
+}
+
+dynamic_bvh::dynamic_bvh(float margin) : _margin(margin) {}
+
+dynamic_bvh::handle dynamic_bvh::insert(const aabb& box, uint32_t user_data)
+{
+	const auto leaf = allocate_node();
+	_nodes[leaf].box = fatten(box);
+	_nodes[leaf].user_data = user_data;
+	_nodes[leaf].height = 0;
+	insert_leaf(leaf);
+	_leaf_count++;
+	return leaf;
+}
+
+bool dynamic_bvh::remove(handle h)
+{
+	if (!valid(h))
+		return false;
+
+	remove_leaf(h);
+	free_node(h);
+	_leaf_count--;
+	return true;
+}
+
+bool dynamic_bvh::move(handle h, const aabb& box, const vec2& displacement)
+{
+	if (!valid(h) || _nodes[h].box.contains(box))
+		return false;
+
+	remove_leaf(h);
+
+	// Stretch the box in the direction of the motion, so it takes a while
+	// before this object needs to be reinserted again
+	aabb fat = fatten(box);
+	const vec2 d = 2.0f * displacement;
+	if (d.x < 0.0f)
+		fat.min.x += d.x;
+	else
+		fat.max.x += d.x;
+	if (d.y < 0.0f)
+		fat.min.y += d.y;
+	else
+		fat.max.y += d.y;
+	_nodes[h].box = fat;
+
+	insert_leaf(h);
+	return true;
+}
+
+dynamic_bvh::handle dynamic_bvh::allocate_node()
+{
+	if (_free == null_handle)
+	{
+		_nodes.emplace_back();
+		return handle(_nodes.size() - 1);
+	}
+
+	const auto h = _free;
+	_free = _nodes[h].parent;
+	_nodes[h] = node();
+	return h;
+}
+
+void dynamic_bvh::free_node(handle h)
+{
+	_nodes[h].parent = _free;
+	_nodes[h].height = -1;
+	_free = h;
+}
+
+void dynamic_bvh::insert_leaf(handle leaf)
+{
+	if (_root == null_handle)
+	{
+		_root = leaf;
+		_nodes[leaf].parent = null_handle;
+		return;
+	}
+
+	// Walk down to the cheapest sibling, where the cost is the perimeter added
+	// to the tree by putting the leaf there
+	const aabb leaf_box = _nodes[leaf].box;
+	handle index = _root;
+	while (!_nodes[index].leaf())
+	{
+		const auto& n = _nodes[index];
+		const float perimeter = n.box.perimeter();
+		const float combined = combine(n.box, leaf_box).perimeter();
+
+		// Cost of making a new parent for this node and the leaf
+		const float cost = 2.0f * combined;
+
+		// Minimum cost of pushing the leaf further down
+		const float inheritance = 2.0f * (combined - perimeter);
+
+		auto descend_cost = [&](handle child)
+		{
+			const auto& c = _nodes[child];
+			const float p = combine(c.box, leaf_box).perimeter();
+			return (c.leaf() ? p : p - c.box.perimeter()) + inheritance;
+		};
+		const float cost1 = descend_cost(n.child1);
+		const float cost2 = descend_cost(n.child2);
+
+		if (cost < cost1 && cost < cost2)
+			break;
+		index = cost1 < cost2 ? n.child1 : n.child2;
+	}
+
+	const auto sibling = index;
+	const auto old_parent = _nodes[sibling].parent;
+	const auto new_parent = allocate_node();
+	_nodes[new_parent].parent = old_parent;
+	_nodes[new_parent].box = combine(leaf_box, _nodes[sibling].box);
+	_nodes[new_parent].height = _nodes[sibling].height + 1;
+	_nodes[new_parent].child1 = sibling;
+	_nodes[new_parent].child2 = leaf;
+	_nodes[sibling].parent = new_parent;
+	_nodes[leaf].parent = new_parent;
+
+	if (old_parent == null_handle)
+		_root = new_parent;
+	else if (_nodes[old_parent].child1 == sibling)
+		_nodes[old_parent].child1 = new_parent;
+	else
+		_nodes[old_parent].child2 = new_parent;
+
+	refit_ancestors(new_parent);
+}
+
+void dynamic_bvh::remove_leaf(handle leaf)
+{
+	if (leaf == _root)
+	{
+		_root = null_handle;
+		return;
+	}
+
+	const auto parent = _nodes[leaf].parent;
+	const auto grand_parent = _nodes[parent].parent;
+	const auto sibling = _nodes[parent].child1 == leaf ?
+		_nodes[parent].child2 :
+		_nodes[parent].child1;
+
+	_nodes[sibling].parent = grand_parent;
+	free_node(parent);
+
+	if (grand_parent == null_handle)
+	{
+		_root = sibling;
+		return;
+	}
+
+	if (_nodes[grand_parent].child1 == parent)
+		_nodes[grand_parent].child1 = sibling;
+	else
+		_nodes[grand_parent].child2 = sibling;
+	refit_ancestors(grand_parent);
+}
+
+void dynamic_bvh::refit_ancestors(handle h)
+{
+	while (h != null_handle)
+	{
+		auto& n = _nodes[h];
+		n.box = combine(_nodes[n.child1].box, _nodes[n.child2].box);
+		n.height = 1 + std::max(_nodes[n.child1].height, _nodes[n.child2].height);
+		rotate(h);
+		h = n.parent;
+	}
+}
+
+void dynamic_bvh::rotate(handle a)
+{
+	// Tries to swap one child of a with a grandchild under the other child.
+	// The set of leaves under a stays the same, so its box doesn't change,
+	// only the box of the child that receives the swapped node does.
+	const auto b = _nodes[a].child1;
+	const auto c = _nodes[a].child2;
+
+	handle best_child = null_handle;		// Child of a that moves down
+	handle best_grand_child = null_handle;	// Grandchild that moves up
+	float best_cost = 0.0f;
+
+	auto try_swap = [&](handle child, handle other)
+	{
+		const auto& o = _nodes[other];
+		if (o.leaf())
+			return;
+		const float base = o.box.perimeter();
+		const float cost1 = combine(_nodes[child].box, _nodes[o.child2].box).perimeter() - base;
+		const float cost2 = combine(_nodes[child].box, _nodes[o.child1].box).perimeter() - base;
+		if (cost1 < best_cost)
+		{
+			best_cost = cost1;
+			best_child = child;
+			best_grand_child = o.child1;
+		}
+		if (cost2 < best_cost)
+		{
+			best_cost = cost2;
+			best_child = child;
+			best_grand_child = o.child2;
+		}
+	};
+	try_swap(b, c);
+	try_swap(c, b);
+
+	if (best_child == null_handle)
+		return;
+
+	const auto other = best_child == b ? c : b;
+	auto& o = _nodes[other];
+
+	if (_nodes[a].child1 == best_child)
+		_nodes[a].child1 = best_grand_child;
+	else
+		_nodes[a].child2 = best_grand_child;
+	_nodes[best_grand_child].parent = a;
+
+	if (o.child1 == best_grand_child)
+		o.child1 = best_child;
+	else
+		o.child2 = best_child;
+	_nodes[best_child].parent = other;
+
+	o.box = combine(_nodes[o.child1].box, _nodes[o.child2].box);
+	o.height = 1 + std::max(_nodes[o.child1].height, _nodes[o.child2].height);
+	_nodes[a].height = 1 + std::max(_nodes[best_grand_child].height, o.height);
+}
+
+void dynamic_bvh::refit_subtree(handle h)
+{
+	auto& n = _nodes[h];
+	if (n.leaf())
+		return;
+	refit_subtree(n.child1);
+	refit_subtree(n.child2);
+	n.box = combine(_nodes[n.child1].box, _nodes[n.child2].box);
+}
+
+aabb dynamic_bvh::fatten(const aabb& box) const
+{
+	const vec2 margin(_margin, _margin);
+	return aabb(box.min - margin, box.max + margin);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "aabb.h"
+#include "growable_stack.h"
+
+/// Bounding volume hierarchy that is updated in place as objects are added,
+/// removed and moved. Leaves store a fattened box, so an object can move a bit
+/// before the tree needs to change. Ancestors are refit bottom-up after every
+/// change and rotated when that lowers the total perimeter, which keeps the
+/// tree from degrading over time.
+class dynamic_bvh
+{
+public:
+	using handle = int32_t;
+	static const handle null_handle = -1;
+
+	/// The margin is added on every side of the boxes stored in the leaves
+	explicit dynamic_bvh(float margin = 4.0f);
+
+	/// Adds a box and returns the handle to refer to it
+	handle insert(const aabb& box, uint32_t user_data);
+
+	/// Removes a box, the handle can be reused by a later insert.
+	/// Returns false if the handle was already removed.
+	bool remove(handle h);
+
+	/// Moves a box. Nothing happens while the box stays inside its fattened box,
+	/// otherwise the leaf is reinserted, extended in the direction of the
+	/// displacement. Returns true if the tree changed, false for a removed handle.
+	bool move(handle h, const aabb& box, const glm::vec2& displacement = glm::vec2(0.0f));
+
+	/// Gives every leaf a new box, obtained with get_box(user_data), and refits
+	/// all the interior nodes in a single pass. Cheaper than moving every
+	/// object one by one, but the structure of the tree stays the same.
+	template <typename F>
+	void refit_all(F&& get_box);
+
+	/// Calls callback(handle) for every fattened box containing the point,
+	/// stops early when the callback returns false
+	template <typename F>
+	void query(const glm::vec2& point, F&& callback) const;
+
+	/// Calls callback(handle) for every fattened box overlapping the box,
+	/// stops early when the callback returns false
+	template <typename F>
+	void query(const aabb& box, F&& callback) const;
+
+	/// Whether the handle refers to a box in the tree. A removed handle stays
+	/// invalid until a later insert reuses its node.
+	bool valid(handle h) const { return h >= 0 && h < handle(_nodes.size()) && _nodes[h].height == 0; }
+
+	uint32_t user_data(handle h) const { return _nodes[h].user_data; }
+	const aabb& fat_box(handle h) const { return _nodes[h].box; }
+
+	/// Number of boxes in the tree
+	size_t size() const { return _leaf_count; }
+
+	/// Longest path from the root to a leaf
+	int height() const { return _root == null_handle ? 0 : _nodes[_root].height; }
+
+	/// Bytes used by the node pool
+	size_t memory_usage() const { return _nodes.capacity() * sizeof(node); }
+
+private:
+	struct node
+	{
+		aabb box;
+		handle parent		= null_handle;	// Next free node when not in use
+		handle child1		= null_handle;
+		handle child2		= null_handle;
+		int32_t height		= -1;			// Zero for leaves, -1 for free nodes
+		uint32_t user_data	= 0;
+
+		bool leaf() const { return child1 == null_handle; }	// Also true for free nodes
+	};
+
+	handle allocate_node();
+	void free_node(handle h);
+	void insert_leaf(handle leaf);
+	void remove_leaf(handle leaf);
+	void refit_ancestors(handle h);
+	void rotate(handle h);
+	void refit_subtree(handle h);
+	aabb fatten(const aabb& box) const;
+
+	std::vector<node>	_nodes;
+	handle				_root		= null_handle;
+	handle				_free		= null_handle;
+	size_t				_leaf_count	= 0;
+	float				_margin;
+};
+
+template <typename F>
+void dynamic_bvh::refit_all(F&& get_box)
+{
+	for (auto& n : _nodes)
+	{
+		if (n.height != 0)
+			continue;
+		const aabb box = get_box(n.user_data);
+		if (!n.box.contains(box))
+			n.box = fatten(box);
+	}
+	if (_root != null_handle)
+		refit_subtree(_root);
+}
+
+template <typename F>
+void dynamic_bvh::query(const glm::vec2& point, F&& callback) const
+{
+	query(aabb(point, point), callback);
+}
+
+template <typename F>
+void dynamic_bvh::query(const aabb& box, F&& callback) const
+{
+	if (_root == null_handle)
+		return;
+
+	growable_stack<handle, 64> stack;
+	stack.push(_root);
+	while (!stack.empty())
+	{
+		const auto& n = _nodes[stack.pop()];
+		if (!n.box.overlap(box))
+			continue;
+
+		if (n.leaf())
+		{
+			if (!callback(handle(&n - _nodes.data())))
+				return;
+		}
+		else
+		{
+			stack.push(n.child1);
+			stack.push(n.child2);
+		}
+	}
+}
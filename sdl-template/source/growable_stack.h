@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/// Stack that keeps its first N entries inline and only allocates past that.
+/// Used for tree traversals, where the depth is small but not bounded.
+template <typename T, size_t N>
+class growable_stack
+{
+public:
+	void push(const T& value)
+	{
+		if (_count < N)
+			_fixed[_count] = value;
+		else
+			_overflow.push_back(value);
+		_count++;
+	}
+
+	T pop()
+	{
+		_count--;
+		if (_count < N)
+			return _fixed[_count];
+		T value = _overflow.back();
+		_overflow.pop_back();
+		return value;
+	}
+
+	bool empty() const { return _count == 0; }
+
+private:
+	T				_fixed[N];
+	std::vector<T>	_overflow;
+	size_t			_count = 0;
+};
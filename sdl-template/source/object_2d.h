@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL.h>
+#include <glm.hpp>
+
+/// A circle in the scene
+struct object_2d
+{
+	glm::vec2 position;
+	float radius;
+	SDL_Color color;
+};
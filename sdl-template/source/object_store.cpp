@@ -0,0 +1,423 @@
+#include "object_store.h"
+#include <algorithm>
+#include "spatial_index.h"
+
+using namespace glm;
+
+namespace
+{
+	/// Arrays are padded to a multiple of this, so kernels can read whole groups
+	const size_t padding = 8;
+
+	/// Appends base plus the index of every set bit
+	SIMD_INLINE uint32_t emit(uint32_t mask, uint32_t base, uint32_t* hits, uint32_t count)
+	{
+		while (mask)
+		{
+			hits[count++] = base + lowest_bit(mask);
+			mask &= mask - 1;
+		}
+		return count;
+	}
+
+	/// Mask of the lanes of a group starting at i that are below count
+	SIMD_INLINE uint32_t valid_lanes(uint32_t i, uint32_t count, uint32_t width)
+	{
+		return i + width <= count ? (1u << width) - 1 : (1u << (count - i)) - 1;
+	}
+}
+
+// Every kernel tests count objects starting at x, y and r and writes base plus
+// the lane of each one that passes to hits. The scalar kernel is the reference,
+// the others do the same arithmetic in the same order so results match exactly.
+struct object_store::kernels
+{
+	struct scalar
+	{
+		static uint32_t point(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			float px, float py, uint32_t* hits)
+		{
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const float dx = px - x[i];
+				const float dy = py - y[i];
+				if (dx * dx + dy * dy < r[i] * r[i])
+					hits[found++] = base + i;
+			}
+			return found;
+		}
+
+		static uint32_t circle(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			float cx, float cy, float radius, uint32_t* hits)
+		{
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const float dx = cx - x[i];
+				const float dy = cy - y[i];
+				const float rr = radius + r[i];
+				if (dx * dx + dy * dy < rr * rr)
+					hits[found++] = base + i;
+			}
+			return found;
+		}
+
+		static uint32_t range(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			const aabb& box, uint32_t* hits)
+		{
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const float dx = std::max(std::max(box.min.x - x[i], x[i] - box.max.x), 0.0f);
+				const float dy = std::max(std::max(box.min.y - y[i], y[i] - box.max.y), 0.0f);
+				if (dx * dx + dy * dy < r[i] * r[i])
+					hits[found++] = base + i;
+			}
+			return found;
+		}
+	};
+
+#if SIMD_X64
+	struct sse2
+	{
+		static uint32_t point(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			float px, float py, uint32_t* hits)
+		{
+			const __m128 vx = _mm_set1_ps(px);
+			const __m128 vy = _mm_set1_ps(py);
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i += 4)
+			{
+				const __m128 dx = _mm_sub_ps(vx, _mm_loadu_ps(x + i));
+				const __m128 dy = _mm_sub_ps(vy, _mm_loadu_ps(y + i));
+				const __m128 rr = _mm_loadu_ps(r + i);
+				const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+				const uint32_t mask = uint32_t(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(rr, rr))));
+				found = emit(mask & valid_lanes(i, count, 4), base + i, hits, found);
+			}
+			return found;
+		}
+
+		static uint32_t circle(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			float cx, float cy, float radius, uint32_t* hits)
+		{
+			const __m128 vx = _mm_set1_ps(cx);
+			const __m128 vy = _mm_set1_ps(cy);
+			const __m128 vr = _mm_set1_ps(radius);
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i += 4)
+			{
+				const __m128 dx = _mm_sub_ps(vx, _mm_loadu_ps(x + i));
+				const __m128 dy = _mm_sub_ps(vy, _mm_loadu_ps(y + i));
+				const __m128 rr = _mm_add_ps(vr, _mm_loadu_ps(r + i));
+				const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+				const uint32_t mask = uint32_t(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(rr, rr))));
+				found = emit(mask & valid_lanes(i, count, 4), base + i, hits, found);
+			}
+			return found;
+		}
+
+		static uint32_t range(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			const aabb& box, uint32_t* hits)
+		{
+			const __m128 min_x = _mm_set1_ps(box.min.x);
+			const __m128 min_y = _mm_set1_ps(box.min.y);
+			const __m128 max_x = _mm_set1_ps(box.max.x);
+			const __m128 max_y = _mm_set1_ps(box.max.y);
+			const __m128 zero = _mm_setzero_ps();
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i += 4)
+			{
+				const __m128 px = _mm_loadu_ps(x + i);
+				const __m128 py = _mm_loadu_ps(y + i);
+				const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, px), _mm_sub_ps(px, max_x)), zero);
+				const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_y, py), _mm_sub_ps(py, max_y)), zero);
+				const __m128 rr = _mm_loadu_ps(r + i);
+				const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+				const uint32_t mask = uint32_t(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(rr, rr))));
+				found = emit(mask & valid_lanes(i, count, 4), base + i, hits, found);
+			}
+			return found;
+		}
+	};
+
+	struct avx2
+	{
+		SIMD_TARGET_AVX2 static uint32_t point(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			float px, float py, uint32_t* hits)
+		{
+			const __m256 vx = _mm256_set1_ps(px);
+			const __m256 vy = _mm256_set1_ps(py);
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i += 8)
+			{
+				const __m256 dx = _mm256_sub_ps(vx, _mm256_loadu_ps(x + i));
+				const __m256 dy = _mm256_sub_ps(vy, _mm256_loadu_ps(y + i));
+				const __m256 rr = _mm256_loadu_ps(r + i);
+				const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+				const uint32_t mask = uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(rr, rr), _CMP_LT_OQ)));
+				found = emit(mask & valid_lanes(i, count, 8), base + i, hits, found);
+			}
+			return found;
+		}
+
+		SIMD_TARGET_AVX2 static uint32_t circle(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			float cx, float cy, float radius, uint32_t* hits)
+		{
+			const __m256 vx = _mm256_set1_ps(cx);
+			const __m256 vy = _mm256_set1_ps(cy);
+			const __m256 vr = _mm256_set1_ps(radius);
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i += 8)
+			{
+				const __m256 dx = _mm256_sub_ps(vx, _mm256_loadu_ps(x + i));
+				const __m256 dy = _mm256_sub_ps(vy, _mm256_loadu_ps(y + i));
+				const __m256 rr = _mm256_add_ps(vr, _mm256_loadu_ps(r + i));
+				const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+				const uint32_t mask = uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(rr, rr), _CMP_LT_OQ)));
+				found = emit(mask & valid_lanes(i, count, 8), base + i, hits, found);
+			}
+			return found;
+		}
+
+		SIMD_TARGET_AVX2 static uint32_t range(const float* x, const float* y, const float* r, uint32_t count, uint32_t base,
+			const aabb& box, uint32_t* hits)
+		{
+			const __m256 min_x = _mm256_set1_ps(box.min.x);
+			const __m256 min_y = _mm256_set1_ps(box.min.y);
+			const __m256 max_x = _mm256_set1_ps(box.max.x);
+			const __m256 max_y = _mm256_set1_ps(box.max.y);
+			const __m256 zero = _mm256_setzero_ps();
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < count; i += 8)
+			{
+				const __m256 px = _mm256_loadu_ps(x + i);
+				const __m256 py = _mm256_loadu_ps(y + i);
+				const __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(min_x, px), _mm256_sub_ps(px, max_x)), zero);
+				const __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(min_y, py), _mm256_sub_ps(py, max_y)), zero);
+				const __m256 rr = _mm256_loadu_ps(r + i);
+				const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+				const uint32_t mask = uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(rr, rr), _CMP_LT_OQ)));
+				found = emit(mask & valid_lanes(i, count, 8), base + i, hits, found);
+			}
+			return found;
+		}
+	};
+#endif
+};
+
+object_store::object_store(simd_level level) :
+	_level(std::min(level, detect_simd_level()))
+{
+}
+
+object_store::object_store(const std::vector<object_2d>& objects, simd_level level) :
+	object_store(level)
+{
+	const size_t padded = (objects.size() + padding - 1) / padding * padding;
+	_x.reserve(padded);
+	_y.reserve(padded);
+	_radius.reserve(padded);
+	_color.reserve(objects.size());
+	_handles.reserve(objects.size());
+	_slots.reserve(objects.size());
+	for (const auto& o : objects)
+		insert(o);
+}
+
+object_handle object_store::insert(const object_2d& object)
+{
+	const auto packed = uint32_t(size());
+
+	uint32_t index;
+	if (_free != UINT32_MAX)
+	{
+		index = _free;
+		_free = _slots[index].packed;
+		_slots[index].packed = packed;
+		_slots[index].generation++;
+	}
+	else
+	{
+		index = uint32_t(_slots.size());
+		_slots.push_back({ packed, 1 });
+	}
+
+	// Grow the float arrays a group at a time, the padding stays zero
+	if (packed == _x.size())
+	{
+		_x.resize(packed + padding, 0.0f);
+		_y.resize(packed + padding, 0.0f);
+		_radius.resize(packed + padding, 0.0f);
+	}
+	_x[packed] = object.position.x;
+	_y[packed] = object.position.y;
+	_radius[packed] = object.radius;
+	_color.push_back(object.color);
+
+	object_handle handle;
+	handle.index = index;
+	handle.generation = _slots[index].generation;
+	_handles.push_back(handle);
+	return handle;
+}
+
+bool object_store::remove(object_handle handle)
+{
+	if (!valid(handle))
+		return false;
+
+	// Move the last object into the hole
+	const uint32_t packed = _slots[handle.index].packed;
+	const auto last = uint32_t(size() - 1);
+	if (packed != last)
+	{
+		_x[packed] = _x[last];
+		_y[packed] = _y[last];
+		_radius[packed] = _radius[last];
+		_color[packed] = _color[last];
+		_handles[packed] = _handles[last];
+		_slots[_handles[packed].index].packed = packed;
+	}
+	_x[last] = 0.0f;
+	_y[last] = 0.0f;
+	_radius[last] = 0.0f;
+	_color.pop_back();
+	_handles.pop_back();
+
+	auto& s = _slots[handle.index];
+	s.generation++;
+	s.packed = _free;
+	_free = handle.index;
+	return true;
+}
+
+bool object_store::valid(object_handle handle) const
+{
+	return handle.index < _slots.size() && _slots[handle.index].generation == handle.generation;
+}
+
+object_2d object_store::get(object_handle handle) const
+{
+	const auto i = packed_index(handle);
+	object_2d object;
+	object.position = vec2(_x[i], _y[i]);
+	object.radius = _radius[i];
+	object.color = _color[i];
+	return object;
+}
+
+vec2 object_store::position(object_handle handle) const
+{
+	const auto i = packed_index(handle);
+	return vec2(_x[i], _y[i]);
+}
+
+void object_store::set_position(object_handle handle, const vec2& position)
+{
+	const auto i = packed_index(handle);
+	_x[i] = position.x;
+	_y[i] = position.y;
+}
+
+float object_store::radius(object_handle handle) const
+{
+	return _radius[packed_index(handle)];
+}
+
+void object_store::set_radius(object_handle handle, float radius)
+{
+	_radius[packed_index(handle)] = radius;
+}
+
+SDL_Color object_store::color(object_handle handle) const
+{
+	return _color[packed_index(handle)];
+}
+
+void object_store::set_color(object_handle handle, SDL_Color color)
+{
+	_color[packed_index(handle)] = color;
+}
+
+size_t object_store::get_overlap(const vec2& point, object_handle* overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_point(point, visitor); },
+		overlap, capacity);
+}
+
+size_t object_store::get_overlap(const vec2& center, float radius, object_handle* overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_circle(center, radius, visitor); },
+		overlap, capacity);
+}
+
+size_t object_store::get_overlap(const aabb& range, object_handle* overlap, size_t capacity) const
+{
+	return collect(
+		[&](auto&& visitor) { query_range(range, visitor); },
+		overlap, capacity);
+}
+
+size_t object_store::memory_usage() const
+{
+	return
+		(_x.capacity() + _y.capacity() + _radius.capacity()) * sizeof(float) +
+		_color.capacity() * sizeof(SDL_Color) +
+		_handles.capacity() * sizeof(object_handle) +
+		_slots.capacity() * sizeof(slot);
+}
+
+uint32_t object_store::test_point(size_t first, const vec2& point, uint32_t* hits) const
+{
+	const auto count = uint32_t(std::min(size() - first, size_t(block_size)));
+	const auto base = uint32_t(first);
+	switch (_level)
+	{
+#if SIMD_X64
+	case simd_level::avx2:
+		return kernels::avx2::point(&_x[first], &_y[first], &_radius[first], count, base, point.x, point.y, hits);
+	case simd_level::sse2:
+		return kernels::sse2::point(&_x[first], &_y[first], &_radius[first], count, base, point.x, point.y, hits);
+#endif
+	default:
+		return kernels::scalar::point(&_x[first], &_y[first], &_radius[first], count, base, point.x, point.y, hits);
+	}
+}
+
+uint32_t object_store::test_circle(size_t first, const vec2& center, float radius, uint32_t* hits) const
+{
+	const auto count = uint32_t(std::min(size() - first, size_t(block_size)));
+	const auto base = uint32_t(first);
+	switch (_level)
+	{
+#if SIMD_X64
+	case simd_level::avx2:
+		return kernels::avx2::circle(&_x[first], &_y[first], &_radius[first], count, base, center.x, center.y, radius, hits);
+	case simd_level::sse2:
+		return kernels::sse2::circle(&_x[first], &_y[first], &_radius[first], count, base, center.x, center.y, radius, hits);
+#endif
+	default:
+		return kernels::scalar::circle(&_x[first], &_y[first], &_radius[first], count, base, center.x, center.y, radius, hits);
+	}
+}
+
+uint32_t object_store::test_range(size_t first, const aabb& range, uint32_t* hits) const
+{
+	const auto count = uint32_t(std::min(size() - first, size_t(block_size)));
+	const auto base = uint32_t(first);
+	switch (_level)
+	{
+#if SIMD_X64
+	case simd_level::avx2:
+		return kernels::avx2::range(&_x[first], &_y[first], &_radius[first], count, base, range, hits);
+	case simd_level::sse2:
+		return kernels::sse2::range(&_x[first], &_y[first], &_radius[first], count, base, range, hits);
+#endif
+	default:
+		return kernels::scalar::range(&_x[first], &_y[first], &_radius[first], count, base, range, hits);
+	}
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "aabb.h"
+#include "simd.h"
+
+/// Refers to an object in an object_store. Stays valid while the object
+/// lives, no matter how many others are added or removed around it.
+struct object_handle
+{
+	uint32_t index		= 0;	// Slot of the object, stable for its lifetime
+	uint32_t generation	= 0;	// Bumped when the slot is reused, zero is never valid
+
+	bool operator==(const object_handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const object_handle& other) const { return !(*this == other); }
+};
+
+/// Objects kept as separate x, y, radius and color arrays, so scans only touch
+/// the data they test. Live objects are packed at the front, a removal moves
+/// the last object into the hole. Handles go through a slot table, so they
+/// survive the move and can tell when their object is gone.
+class object_store
+{
+public:
+	/// Queries use the given level, or the best one the cpu supports if that is lower
+	explicit object_store(simd_level level = detect_simd_level());
+
+	/// Adds the objects in order, the handle of objects[i] has index i
+	explicit object_store(const std::vector<object_2d>& objects, simd_level level = detect_simd_level());
+
+	object_handle insert(const object_2d& object);
+
+	/// Returns false if the handle was already removed
+	bool remove(object_handle handle);
+
+	bool valid(object_handle handle) const;
+
+	/// Copies the object out, the handle has to be valid
+	object_2d get(object_handle handle) const;
+
+	glm::vec2 position(object_handle handle) const;
+	void set_position(object_handle handle, const glm::vec2& position);
+
+	float radius(object_handle handle) const;
+	void set_radius(object_handle handle, float radius);
+
+	SDL_Color color(object_handle handle) const;
+	void set_color(object_handle handle, SDL_Color color);
+
+	/// Number of live objects
+	size_t size() const { return _handles.size(); }
+
+	// Packed arrays of the live objects, size() long. Positions change when objects are removed.
+	const float* x() const { return _x.data(); }
+	const float* y() const { return _y.data(); }
+	const float* radii() const { return _radius.data(); }
+	const SDL_Color* colors() const { return _color.data(); }
+
+	/// Handle of the object at a position in the packed arrays
+	object_handle handle(size_t i) const { return _handles[i]; }
+
+	/// Position of the object in the packed arrays, the handle has to be valid
+	size_t packed_index(object_handle handle) const { return _slots[handle.index].packed; }
+
+	/// Calls the visitor with the handle of each object containing the point,
+	/// until it returns false
+	template <typename V>
+	void query_point(const glm::vec2& point, V&& visitor) const;
+
+	/// Calls the visitor with the handle of each object overlapping the circle,
+	/// until it returns false
+	template <typename V>
+	void query_circle(const glm::vec2& center, float radius, V&& visitor) const;
+
+	/// Calls the visitor with the handle of each object overlapping the box,
+	/// until it returns false
+	template <typename V>
+	void query_range(const aabb& range, V&& visitor) const;
+
+	// Buffer versions of the queries. The total number found is returned,
+	// only the first capacity are written.
+	size_t get_overlap(const glm::vec2& point, object_handle* overlap, size_t capacity) const;
+	size_t get_overlap(const glm::vec2& center, float radius, object_handle* overlap, size_t capacity) const;
+	size_t get_overlap(const aabb& range, object_handle* overlap, size_t capacity) const;
+
+	simd_level level() const { return _level; }
+
+	/// Bytes used by the arrays and the slot table
+	size_t memory_usage() const;
+
+	/// Objects tested by one kernel call
+	enum { block_size = 256 };
+
+private:
+	struct slot
+	{
+		uint32_t packed;		// Position in the packed arrays, or the next free slot
+		uint32_t generation;	// Odd while the slot holds an object
+	};
+
+	struct kernels;
+
+	// Each test scans the block starting at first and writes the packed
+	// indices of the objects that pass to hits. Returns how many did.
+	uint32_t test_point(size_t first, const glm::vec2& point, uint32_t* hits) const;
+	uint32_t test_circle(size_t first, const glm::vec2& center, float radius, uint32_t* hits) const;
+	uint32_t test_range(size_t first, const aabb& range, uint32_t* hits) const;
+
+	template <typename T, typename V>
+	void query(T&& test, V&& visitor) const;
+
+	std::vector<float>			_x;
+	std::vector<float>			_y;
+	std::vector<float>			_radius;
+	std::vector<SDL_Color>		_color;
+	std::vector<object_handle>	_handles;
+	std::vector<slot>			_slots;
+	uint32_t					_free		= UINT32_MAX;
+	simd_level					_level;
+};
+
+template <typename T, typename V>
+void object_store::query(T&& test, V&& visitor) const
+{
+	uint32_t hits[block_size];
+	for (size_t first = 0; first < size(); first += block_size)
+	{
+		const uint32_t count = test(first, hits);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (!visitor(_handles[hits[i]]))
+				return;
+		}
+	}
+}
+
+template <typename V>
+void object_store::query_point(const glm::vec2& point, V&& visitor) const
+{
+	query([&](size_t first, uint32_t* hits) { return test_point(first, point, hits); }, visitor);
+}
+
+template <typename V>
+void object_store::query_circle(const glm::vec2& center, float radius, V&& visitor) const
+{
+	query([&](size_t first, uint32_t* hits) { return test_circle(first, center, radius, hits); }, visitor);
+}
+
+template <typename V>
+void object_store::query_range(const aabb& range, V&& visitor) const
+{
+	query([&](size_t first, uint32_t* hits) { return test_range(first, range, hits); }, visitor);
+}
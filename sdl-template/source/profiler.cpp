@@ -0,0 +1,153 @@
+#include "profiler.h"
+#include <SDL_test_font.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	/// Sorts just enough of the samples to find the given percentile
+	double percentile(std::vector<float>& samples, double fraction)
+	{
+		const auto nth = samples.begin() + size_t(fraction * double(samples.size() - 1) + 0.5);
+		std::nth_element(samples.begin(), nth, samples.end());
+		return *nth;
+	}
+
+	/// Escapes the characters JSON doesn't allow inside a string
+	std::string escape(const char* text)
+	{
+		std::string result;
+		for (const char* c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				result += '\\';
+			if (*c >= 0 && *c < ' ')
+				continue;
+			result += *c;
+		}
+		return result;
+	}
+}
+
+profiler::profiler() :
+	_epoch(clock::now())
+{
+	_events.reserve(trace_size);
+}
+
+void profiler::record(const char* name, clock::time_point start, clock::time_point end)
+{
+	const double start_us = std::chrono::duration<double, std::micro>(start - _epoch).count();
+	const double duration_us = std::chrono::duration<double, std::micro>(end - start).count();
+	const auto id = std::this_thread::get_id();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	const uint32_t z = find_zone(name);
+	auto& samples = _zones[z];
+	if (samples.history.size() < history_size)
+		samples.history.push_back(float(duration_us));
+	else
+		samples.history[samples.samples % history_size] = float(duration_us);
+	samples.samples++;
+
+	const event e = { z, find_thread(id), start_us, duration_us };
+	if (_events.size() < trace_size)
+		_events.push_back(e);
+	else
+		_events[_next_event] = e;
+	_next_event = (_next_event + 1) % trace_size;
+}
+
+std::vector<profile_stats> profiler::stats() const
+{
+	std::vector<profile_stats> result;
+	std::vector<float> samples;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const auto& z : _zones)
+	{
+		samples = z.history;
+		profile_stats s = { z.name, z.samples, 0.0, 0.0, 0.0 };
+		if (!samples.empty())
+		{
+			s.p50 = percentile(samples, 0.50);
+			s.p95 = percentile(samples, 0.95);
+			s.p99 = percentile(samples, 0.99);
+		}
+		result.push_back(s);
+	}
+	return result;
+}
+
+void profiler::draw_overlay(SDL_Renderer* renderer, int x, int y) const
+{
+	const int line_height = 10;
+	char line[128];
+
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	snprintf(line, sizeof(line), "%-12s %9s %9s %9s", "zone (us)", "p50", "p95", "p99");
+	SDLTest_DrawString(renderer, x, y, line);
+	for (const auto& s : stats())
+	{
+		y += line_height;
+		snprintf(line, sizeof(line), "%-12.12s %9.1f %9.1f %9.1f", s.name, s.p50, s.p95, s.p99);
+		SDLTest_DrawString(renderer, x, y, line);
+	}
+}
+
+bool profiler::export_trace(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Once the buffer wraps around the oldest event is the next one to be overwritten
+	const size_t count = _events.size();
+	const size_t first = count < trace_size ? 0 : _next_event;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto& e = _events[(first + i) % count];
+		fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			escape(_zones[e.zone].name).c_str(), e.thread, e.start, e.duration,
+			i + 1 < count ? "," : "");
+	}
+	fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+profiler& profiler::shared()
+{
+	static profiler instance;
+	return instance;
+}
+
+uint32_t profiler::find_zone(const char* name)
+{
+	// Zone names are literals, so the pointer usually matches. Comparing the
+	// text as well merges zones whose literals weren't pooled together.
+	for (size_t i = 0; i < _zones.size(); i++)
+		if (_zones[i].name == name || strcmp(_zones[i].name, name) == 0)
+			return uint32_t(i);
+
+	_zones.push_back({ name, std::vector<float>(), 0 });
+	_zones.back().history.reserve(history_size);
+	return uint32_t(_zones.size() - 1);
+}
+
+uint32_t profiler::find_thread(std::thread::id id)
+{
+	for (size_t i = 0; i < _threads.size(); i++)
+		if (_threads[i] == id)
+			return uint32_t(i);
+
+	_threads.push_back(id);
+	return uint32_t(_threads.size() - 1);
+}
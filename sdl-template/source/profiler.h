@@ -0,0 +1,112 @@
+#pragma once
+
+#include <SDL.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Zones are compiled in for debug builds only, define PROFILER_ENABLED to override
+#ifndef PROFILER_ENABLED
+#ifdef NDEBUG
+#define PROFILER_ENABLED 0
+#else
+#define PROFILER_ENABLED 1
+#endif
+#endif
+
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+/// Times the rest of the enclosing scope under a name, which must be a string literal
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) profile_zone PROFILER_CONCAT(_profile_zone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+/// Timing statistics of one zone over its recent samples, in microseconds
+struct profile_stats
+{
+	const char* name;
+	size_t samples;
+	double p50;
+	double p95;
+	double p99;
+};
+
+/// Collects zone timings from any thread. Keeps a rolling window of samples
+/// per zone for percentiles and of recent zones for trace export.
+class profiler
+{
+public:
+	typedef std::chrono::high_resolution_clock clock;
+
+	enum
+	{
+		history_size = 256,			///< Samples per zone used for percentiles
+		trace_size = 1 << 16		///< Most recent zones kept for the trace
+	};
+
+	profiler();
+
+	profiler(const profiler&) = delete;
+	profiler& operator=(const profiler&) = delete;
+
+	/// Records a zone that ran from start to end on the calling thread
+	void record(const char* name, clock::time_point start, clock::time_point end);
+
+	/// Percentiles of every zone recorded so far, in the order they were first seen
+	std::vector<profile_stats> stats() const;
+
+	/// Draws one line of stats per zone with its top left corner at x, y
+	void draw_overlay(SDL_Renderer* renderer, int x, int y) const;
+
+	/// Writes the recent zones as Chrome trace event JSON, returns false if the file can't be written
+	bool export_trace(const std::string& path) const;
+
+	/// Profiler used by PROFILE_ZONE
+	static profiler& shared();
+
+private:
+	struct zone
+	{
+		const char* name;
+		std::vector<float> history;
+		size_t samples;
+	};
+
+	struct event
+	{
+		uint32_t zone;
+		uint32_t thread;
+		double start;
+		double duration;
+	};
+
+	uint32_t find_zone(const char* name);
+	uint32_t find_thread(std::thread::id id);
+
+	clock::time_point				_epoch;
+	std::vector<zone>				_zones;
+	std::vector<std::thread::id>	_threads;
+	std::vector<event>				_events;
+	size_t							_next_event = 0;
+	mutable std::mutex				_mutex;
+};
+
+/// Records the time between its construction and destruction with the shared profiler
+class profile_zone
+{
+public:
+	explicit profile_zone(const char* name) : _name(name), _start(profiler::clock::now()) {}
+	~profile_zone() { profiler::shared().record(_name, _start, profiler::clock::now()); }
+
+	profile_zone(const profile_zone&) = delete;
+	profile_zone& operator=(const profile_zone&) = delete;
+
+private:
+	const char*					_name;
+	profiler::clock::time_point	_start;
+};
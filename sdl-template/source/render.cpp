@@ -0,0 +1,135 @@
+#include "render.h"
+#include <cmath>
+
+using namespace glm;
+
+const float pi = 3.14159265359f;
+
+SDL_Renderer* renderer = nullptr;
+
+namespace
+{
+	const int circle_segments = 12;
+
+	/// Points on the unit circle, with the first repeated at the end to close it
+	struct unit_circle
+	{
+		vec2 points[circle_segments + 1];
+
+		unit_circle()
+		{
+			for (int i = 0; i < circle_segments; i++)
+			{
+				const float t = 2.0f * pi * float(i) / float(circle_segments);
+				points[i] = vec2(cos(t), sin(t));
+			}
+			points[circle_segments] = points[0];
+		}
+	};
+
+	const unit_circle& get_unit_circle()
+	{
+		static const unit_circle circle;
+		return circle;
+	}
+
+	SDL_Point to_point(vec2 p)
+	{
+		return { int(p.x), int(p.y) };
+	}
+}
+
+void RenderDrawCircle(SDL_Renderer * renderer,
+	vec2 center,
+	float radius)
+{
+	const auto& circle = get_unit_circle();
+	SDL_Point points[circle_segments + 1];
+	for (int i = 0; i <= circle_segments; i++)
+		points[i] = to_point(center + circle.points[i] * radius);
+	SDL_RenderDrawLines(renderer, points, circle_segments + 1);
+}
+
+void RenderLine(vec2 a, vec2 b)
+{
+	SDL_RenderDrawLine(renderer, int(a.x), int(a.y), int(b.x), int(b.y));
+}
+
+void RenderBox(vec2 min, vec2 max)
+{
+	const SDL_Point points[] =
+	{
+		to_point(vec2(min.x, min.y)),
+		to_point(vec2(max.x, min.y)),
+		to_point(vec2(max.x, max.y)),
+		to_point(vec2(min.x, max.y)),
+		to_point(vec2(min.x, min.y))
+	};
+	SDL_RenderDrawLines(renderer, points, 5);
+}
+
+void render_batch::circle(vec2 center, float radius, SDL_Color color)
+{
+	circles(center, &radius, 1, color);
+}
+
+void render_batch::circles(vec2 center, const float* radii, size_t count, SDL_Color color)
+{
+	// Consecutive rings are joined by a short radial step, which is
+	// hidden between rings drawn a pixel or two apart
+	const auto& circle = get_unit_circle();
+	begin(color);
+	for (size_t r = 0; r < count; r++)
+		for (int i = 0; i <= circle_segments; i++)
+			add(center + circle.points[i] * radii[r]);
+}
+
+void render_batch::box(vec2 min, vec2 max, SDL_Color color)
+{
+	begin(color);
+	add(vec2(min.x, min.y));
+	add(vec2(max.x, min.y));
+	add(vec2(max.x, max.y));
+	add(vec2(min.x, max.y));
+	add(vec2(min.x, min.y));
+}
+
+void render_batch::line(vec2 a, vec2 b, SDL_Color color)
+{
+	begin(color);
+	add(a);
+	add(b);
+}
+
+void render_batch::flush(SDL_Renderer* renderer)
+{
+	_draw_calls = 0;
+	bool has_color = false;
+	SDL_Color current = {};
+	for (const auto& s : _strips)
+	{
+		if (!has_color ||
+			s.color.r != current.r || s.color.g != current.g ||
+			s.color.b != current.b || s.color.a != current.a)
+		{
+			SDL_SetRenderDrawColor(renderer, s.color.r, s.color.g, s.color.b, s.color.a);
+			current = s.color;
+			has_color = true;
+		}
+		SDL_RenderDrawLines(renderer, _points.data() + s.first, int(s.count));
+		_draw_calls++;
+	}
+	_points.clear();
+	_strips.clear();
+}
+
+void render_batch::begin(SDL_Color color)
+{
+	_strips.push_back({ color, uint32_t(_points.size()), 0 });
+}
+
+void render_batch::add(vec2 point)
+{
+	_points.push_back(to_point(point));
+	_strips.back().count++;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <SDL.h>
+#include <glm.hpp>
+#include <vector>
+
+extern SDL_Renderer* renderer;
+
+void RenderDrawCircle(SDL_Renderer* renderer, glm::vec2 center, float radius);
+
+void RenderLine(glm::vec2 a, glm::vec2 b);
+
+void RenderBox(glm::vec2 min, glm::vec2 max);
+
+/// Collects the debug lines of a frame in one vertex buffer and submits
+/// them with one SDL_RenderDrawLines call per strip
+class render_batch
+{
+public:
+	/// Adds a circle outline
+	void circle(glm::vec2 center, float radius, SDL_Color color);
+
+	/// Adds concentric circle outlines, drawn as a single strip
+	void circles(glm::vec2 center, const float* radii, size_t count, SDL_Color color);
+
+	/// Adds a box outline
+	void box(glm::vec2 min, glm::vec2 max, SDL_Color color);
+
+	/// Adds a single line
+	void line(glm::vec2 a, glm::vec2 b, SDL_Color color);
+
+	/// Draws everything added since the last flush and empties the batch
+	void flush(SDL_Renderer* renderer);
+
+	/// The number of SDL_RenderDrawLines calls issued by the last flush
+	size_t draw_calls() const { return _draw_calls; }
+
+private:
+	struct strip
+	{
+		SDL_Color color;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	void begin(SDL_Color color);
+	void add(glm::vec2 point);
+
+	std::vector<SDL_Point> _points;
+	std::vector<strip> _strips;
+	size_t _draw_calls = 0;
+};
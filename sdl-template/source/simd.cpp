@@ -0,0 +1,78 @@
+#include "simd.h"
+
+#if SIMD_X64
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#if SIMD_X64
+	void cpuid(int leaf, int sub_leaf, unsigned info[4])
+	{
+#if defined(_MSC_VER)
+		int regs[4];
+		__cpuidex(regs, leaf, sub_leaf);
+		for (int i = 0; i < 4; i++)
+			info[i] = unsigned(regs[i]);
+#else
+		__cpuid_count(leaf, sub_leaf, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	/// Register state the OS saves on a context switch
+	uint64_t xgetbv()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (uint64_t(edx) << 32) | eax;
+#endif
+	}
+
+	simd_level detect()
+	{
+		unsigned info[4];
+		cpuid(0, 0, info);
+		const unsigned max_leaf = info[0];
+
+		cpuid(1, 0, info);
+		const bool osxsave = (info[2] & (1u << 27)) != 0;
+		const bool avx = (info[2] & (1u << 28)) != 0;
+		if (!osxsave || !avx || max_leaf < 7)
+			return simd_level::sse2;
+
+		// The OS has to save the xmm and ymm registers
+		if ((xgetbv() & 0x6) != 0x6)
+			return simd_level::sse2;
+
+		cpuid(7, 0, info);
+		const bool avx2 = (info[1] & (1u << 5)) != 0;
+		return avx2 ? simd_level::avx2 : simd_level::sse2;
+	}
+#else
+	simd_level detect() { return simd_level::scalar; }
+#endif
+}
+
+simd_level detect_simd_level()
+{
+	static const simd_level level = detect();
+	return level;
+}
+
+const char* simd_level_name(simd_level level)
+{
+	switch (level)
+	{
+	case simd_level::scalar:	return "scalar";
+	case simd_level::sse2:		return "sse2";
+	case simd_level::avx2:		return "avx2";
+	}
+	return "unknown";
+}
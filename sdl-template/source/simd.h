@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X64 1
+#include <immintrin.h>
+#else
+#define SIMD_X64 0
+#endif
+
+// Functions marked with SIMD_TARGET_AVX2 can use AVX2 intrinsics without
+// compiling the whole program for AVX2. Only call them after checking
+// detect_simd_level(). MSVC allows the intrinsics anywhere.
+#if defined(_MSC_VER)
+#define SIMD_TARGET_AVX2
+#define SIMD_INLINE __forceinline
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_INLINE inline __attribute__((always_inline))
+#endif
+
+/// Widest instruction set the kernels can use
+enum class simd_level
+{
+	scalar,
+	sse2,
+	avx2
+};
+
+/// Best level supported by the cpu and the OS, detected on the first call
+simd_level detect_simd_level();
+
+/// Name of the level, for logging
+const char* simd_level_name(simd_level level);
+
+/// Index of the lowest set bit, the mask can't be zero
+SIMD_INLINE uint32_t lowest_bit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return uint32_t(index);
+#else
+	return uint32_t(__builtin_ctz(mask));
+#endif
+}
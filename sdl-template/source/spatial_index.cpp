@@ -0,0 +1,21 @@
+#include "spatial_index.h"
+#include "brute_force.h"
+#include "bvh.h"
+#include "compressed_bvh.h"
+#include "uniform_grid.h"
+
+std::unique_ptr<spatial_index> create_spatial_index(spatial_index_type type, std::vector<object_2d>& objects)
+{
+	switch (type)
+	{
+	case spatial_index_type::brute_force:
+		return std::unique_ptr<spatial_index>(new brute_force_index(objects));
+	case spatial_index_type::bvh:
+		return std::unique_ptr<spatial_index>(new bvh(objects));
+	case spatial_index_type::grid:
+		return std::unique_ptr<spatial_index>(new uniform_grid(objects));
+	case spatial_index_type::compressed_bvh:
+		return std::unique_ptr<spatial_index>(new compressed_bvh(objects));
+	}
+	return nullptr;
+}
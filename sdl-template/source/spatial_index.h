@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "aabb.h"
+
+/// Queries shared by all the ways of finding objects, so they can be swapped at runtime.
+/// The objects found are written into the buffer and the total number is returned,
+/// which can be more than the capacity. Only the first capacity are written.
+class spatial_index
+{
+public:
+	virtual ~spatial_index() = default;
+
+	virtual const char* name() const = 0;
+
+	/// Objects containing the point
+	virtual size_t get_overlap(const glm::vec2& point, object_2d** overlap, size_t capacity) const = 0;
+
+	/// Objects overlapping the circle
+	virtual size_t get_overlap(const glm::vec2& center, float radius, object_2d** overlap, size_t capacity) const = 0;
+
+	/// Objects overlapping the box
+	virtual size_t get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const = 0;
+
+	/// Bytes used by the index, not counting the objects
+	virtual size_t memory_usage() const = 0;
+};
+
+enum class spatial_index_type
+{
+	brute_force,
+	bvh,
+	grid,
+	compressed_bvh
+};
+
+/// Buffer version of a visitor query, for the get_overlap implementations.
+/// query(visitor) runs the query, whatever the visitor is given goes through
+/// convert into the buffer. Returns the total number found, only the first
+/// capacity are written.
+template <typename Q, typename T, typename C>
+size_t collect(Q&& query, T* overlap, size_t capacity, C&& convert)
+{
+	size_t count = 0;
+	query([&](auto&& found)
+	{
+		if (count < capacity)
+			overlap[count] = convert(found);
+		count++;
+		return true;
+	});
+	return count;
+}
+
+/// Same, for queries that find what goes into the buffer
+template <typename Q, typename T>
+size_t collect(Q&& query, T* overlap, size_t capacity)
+{
+	return collect(query, overlap, capacity, [](const T& found) { return found; });
+}
+
+/// Builds an index of the given type. The objects need to stay in place while it is used.
+std::unique_ptr<spatial_index> create_spatial_index(spatial_index_type type, std::vector<object_2d>& objects);
@@ -0,0 +1,95 @@
+#include "thread_pool.h"
+
+thread_pool::thread_pool(unsigned thread_count)
+{
+	if (thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+	if (thread_count == 0)
+		thread_count = 1;
+
+	for (unsigned i = 1; i < thread_count; i++)
+		_threads.emplace_back([this] { worker(); });
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_condition.notify_all();
+	for (auto& t : _threads)
+		t.join();
+}
+
+void thread_pool::run(task_group& group, std::function<void()> task)
+{
+	group.pending++;
+
+	// Without workers the caller would run it in wait anyway
+	if (_threads.empty())
+	{
+		thread_pool::task t = { std::move(task), &group };
+		execute(t);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back({ std::move(task), &group });
+	}
+	_condition.notify_one();
+}
+
+void thread_pool::wait(task_group& group)
+{
+	while (group.pending > 0)
+	{
+		if (!run_one())
+			std::this_thread::yield();
+	}
+}
+
+thread_pool& thread_pool::shared()
+{
+	static thread_pool pool;
+	return pool;
+}
+
+void thread_pool::worker()
+{
+	while (true)
+	{
+		task t;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this] { return _quit || !_queue.empty(); });
+			if (_quit && _queue.empty())
+				return;
+			// Newest first, which keeps a recursive build depth-first
+			t = std::move(_queue.back());
+			_queue.pop_back();
+		}
+		execute(t);
+	}
+}
+
+bool thread_pool::run_one()
+{
+	task t;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_queue.empty())
+			return false;
+		t = std::move(_queue.back());
+		_queue.pop_back();
+	}
+	execute(t);
+	return true;
+}
+
+void thread_pool::execute(task& t)
+{
+	t.function();
+	t.group->pending--;
+}
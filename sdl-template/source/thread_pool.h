@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Tracks a set of tasks that can be waited on together
+struct task_group
+{
+	std::atomic<int> pending{ 0 };
+};
+
+/// Fixed set of worker threads running tasks from a shared queue.
+/// A thread that waits on a group keeps running queued tasks until the group
+/// is done, so tasks can spawn and wait on tasks of their own without
+/// blocking the pool.
+class thread_pool
+{
+public:
+	/// Zero threads means one per hardware thread. The calling thread counts as one.
+	explicit thread_pool(unsigned thread_count = 0);
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	/// Queues a task as part of the group
+	void run(task_group& group, std::function<void()> task);
+
+	/// Returns once every task in the group has finished
+	void wait(task_group& group);
+
+	/// Threads that run tasks, including the one waiting
+	unsigned thread_count() const { return unsigned(_threads.size()) + 1; }
+
+	/// Pool shared by everything that doesn't bring its own
+	static thread_pool& shared();
+
+private:
+	struct task
+	{
+		std::function<void()> function;
+		task_group* group;
+	};
+
+	void worker();
+	bool run_one();
+	void execute(task& t);
+
+	std::vector<std::thread>	_threads;
+	std::deque<task>			_queue;
+	std::mutex					_mutex;
+	std::condition_variable		_condition;
+	bool						_quit = false;
+};
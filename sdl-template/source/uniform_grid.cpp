@@ -0,0 +1,175 @@
+#include "uniform_grid.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace glm;
+
+uniform_grid::uniform_grid(std::vector<object_2d>& objects, float cell_size) :
+	_objects(objects.data())
+{
+	if (objects.empty())
+		return;
+
+	aabb bounds;
+	for (const auto& o : objects)
+		bounds.add(o);
+
+	// Cells about as wide as most objects, so an object touches four cells at most
+	if (cell_size <= 0.0f)
+	{
+		std::vector<float> radii(objects.size());
+		for (size_t i = 0; i < objects.size(); i++)
+			radii[i] = objects[i].radius;
+		auto percentile = radii.begin() + radii.size() * 9 / 10;
+		std::nth_element(radii.begin(), percentile, radii.end());
+		cell_size = 2.0f * *percentile;
+	}
+
+	// Sparse scenes would need far more cells than objects, grow the cells instead
+	const vec2 extent = bounds.max - bounds.min;
+	const float max_cells = 4.0f * float(objects.size()) + 16.0f;
+	if (cell_size <= 0.0f || (extent.x / cell_size + 1.0f) * (extent.y / cell_size + 1.0f) > max_cells)
+	{
+		const float area = std::max(extent.x, 1.0f) * std::max(extent.y, 1.0f);
+		cell_size = std::max(cell_size, std::sqrt(area / max_cells));
+		while ((extent.x / cell_size + 1.0f) * (extent.y / cell_size + 1.0f) > max_cells)
+			cell_size *= 1.25f;
+	}
+
+	_origin = bounds.min;
+	_cell_size = cell_size;
+	_inverse_cell_size = 1.0f / cell_size;
+	_columns = int(extent.x * _inverse_cell_size) + 1;
+	_rows = int(extent.y * _inverse_cell_size) + 1;
+
+	// Count the entries of every cell, turn the counts into offsets, then fill them in
+	const size_t cells = size_t(_columns) * size_t(_rows);
+	_cell_start.assign(cells + 1, 0);
+	for (const auto& o : objects)
+	{
+		const int x0 = column(o.position.x - o.radius);
+		const int x1 = column(o.position.x + o.radius);
+		const int y0 = row(o.position.y - o.radius);
+		const int y1 = row(o.position.y + o.radius);
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				_cell_start[size_t(y) * _columns + x + 1]++;
+	}
+	for (size_t i = 0; i < cells; i++)
+		_cell_start[i + 1] += _cell_start[i];
+
+	_entries.resize(_cell_start[cells]);
+	std::vector<uint32_t> cursor(_cell_start.begin(), _cell_start.end() - 1);
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		const auto& o = objects[i];
+		const int x0 = column(o.position.x - o.radius);
+		const int x1 = column(o.position.x + o.radius);
+		const int y0 = row(o.position.y - o.radius);
+		const int y1 = row(o.position.y + o.radius);
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				_entries[cursor[size_t(y) * _columns + x]++] = { o.position, o.radius, uint32_t(i) };
+	}
+}
+
+size_t uniform_grid::get_overlap(const vec2& point, object_2d** overlap, size_t capacity) const
+{
+	if (_columns == 0)
+		return 0;
+
+	const vec2 local = (point - _origin) * _inverse_cell_size;
+	if (local.x < 0.0f || local.y < 0.0f || local.x >= float(_columns) || local.y >= float(_rows))
+		return 0;
+
+	const size_t cell = size_t(local.y) * _columns + size_t(local.x);
+	size_t count = 0;
+	for (uint32_t i = _cell_start[cell]; i < _cell_start[cell + 1]; i++)
+	{
+		const auto& e = _entries[i];
+		const vec2 d = point - e.position;
+		if (dot(d, d) < e.radius * e.radius)
+		{
+			if (count < capacity)
+				overlap[count] = _objects + e.index;
+			count++;
+		}
+	}
+	return count;
+}
+
+size_t uniform_grid::get_overlap(const vec2& center, float radius, object_2d** overlap, size_t capacity) const
+{
+	const vec2 extent(radius, radius);
+	return query(aabb(center - extent, center + extent), [&](const entry& e)
+	{
+		const vec2 d = center - e.position;
+		const float r = radius + e.radius;
+		return dot(d, d) < r * r;
+	}, overlap, capacity);
+}
+
+size_t uniform_grid::get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const
+{
+	return query(range, [&](const entry& e)
+	{
+		return range.distance_squared(e.position) < e.radius * e.radius;
+	}, overlap, capacity);
+}
+
+size_t uniform_grid::memory_usage() const
+{
+	return
+		_cell_start.capacity() * sizeof(uint32_t) +
+		_entries.capacity() * sizeof(entry);
+}
+
+int uniform_grid::column(float x) const
+{
+	// Clamped as a float, huge coordinates don't fit in an int
+	return int(std::min(std::max((x - _origin.x) * _inverse_cell_size, 0.0f), float(_columns - 1)));
+}
+
+int uniform_grid::row(float y) const
+{
+	return int(std::min(std::max((y - _origin.y) * _inverse_cell_size, 0.0f), float(_rows - 1)));
+}
+
+template <typename P>
+size_t uniform_grid::query(const aabb& range, P&& test, object_2d** overlap, size_t capacity) const
+{
+	if (_columns == 0)
+		return 0;
+
+	const int x0 = column(range.min.x);
+	const int x1 = column(range.max.x);
+	const int y0 = row(range.min.y);
+	const int y1 = row(range.max.y);
+
+	size_t count = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			const size_t cell = size_t(y) * _columns + x;
+			for (uint32_t i = _cell_start[cell]; i < _cell_start[cell + 1]; i++)
+			{
+				const auto& e = _entries[i];
+
+				// Objects in several cells are only reported from the first
+				// cell they share with the range
+				if (x != std::max(column(e.position.x - e.radius), x0) ||
+					y != std::max(row(e.position.y - e.radius), y0))
+					continue;
+
+				if (test(e))
+				{
+					if (count < capacity)
+						overlap[count] = _objects + e.index;
+					count++;
+				}
+			}
+		}
+	}
+	return count;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "spatial_index.h"
+
+/// Uniform grid over the bounds of the objects. Every object is listed in each
+/// cell its box touches, so a point query only looks at a single cell. The
+/// lists of all cells are stored back to back in one array, filled with a
+/// counting sort. Works best when the objects are about the same size.
+class uniform_grid : public spatial_index
+{
+public:
+	/// The cell size is derived from the radii when zero.
+	/// The objects need to stay in place while the grid is used.
+	explicit uniform_grid(std::vector<object_2d>& objects, float cell_size = 0.0f);
+
+	const char* name() const override { return "grid"; }
+	size_t get_overlap(const glm::vec2& point, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const glm::vec2& center, float radius, object_2d** overlap, size_t capacity) const override;
+	size_t get_overlap(const aabb& range, object_2d** overlap, size_t capacity) const override;
+	size_t memory_usage() const override;
+
+	float cell_size() const { return _cell_size; }
+	int columns() const { return _columns; }
+	int rows() const { return _rows; }
+
+private:
+	/// Copy of the data needed to test an object, one per cell it touches
+	struct entry
+	{
+		glm::vec2 position;
+		float radius;
+		uint32_t index;
+	};
+
+	int column(float x) const;
+	int row(float y) const;
+
+	template <typename P>
+	size_t query(const aabb& range, P&& test, object_2d** overlap, size_t capacity) const;
+
+	std::vector<uint32_t>	_cell_start;		// Entries of cell i are [_cell_start[i], _cell_start[i + 1])
+	std::vector<entry>		_entries;
+	object_2d*				_objects			= nullptr;
+	glm::vec2				_origin;
+	float					_cell_size			= 1.0f;
+	float					_inverse_cell_size	= 1.0f;
+	int						_columns			= 0;
+	int						_rows				= 0;
+};